@@ -0,0 +1,233 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Load test of network_get_data against the loopback mock node. For each
+ * response size reports throughput, p50/p99 latency and the peak heap used
+ * by nano_rest on top of what was live before the run. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "esp_log.h"
+#include "nano_rest.h"
+#include "heap_trace.h"
+#include "mock_node.h"
+
+static const char BENCH_RPC[] = "{\"action\":\"block_count\"}";
+
+typedef struct bench_worker_t {
+    pthread_t thread;
+    int n_requests;
+    int batch;
+    nano_rest_batch_item_t *items;
+    char *result_buf;
+    size_t result_buf_len;
+    uint64_t *latencies_ns;
+    int errors;
+} bench_worker_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *bench_worker(void *arg) {
+    bench_worker_t *w = arg;
+    for( int i = 0; i < w->n_requests; i++ ) {
+        uint64_t start = now_ns();
+        if( w->batch > 1 ) {
+            int ok = nano_rest_post_batch(w->items, w->batch);
+            w->errors += w->batch - (ok < 0 ? 0 : ok);
+        }
+        else if( 0 != network_get_data((char *)BENCH_RPC,
+                w->result_buf, w->result_buf_len) ) {
+            w->errors++;
+        }
+        w->latencies_ns[i] = now_ns() - start;
+    }
+    return NULL;
+}
+
+static void print_stats(void) {
+    static const char *names[NANO_REST_PHASE_COUNT] = {
+        [NANO_REST_PHASE_DNS] = "dns",
+        [NANO_REST_PHASE_CONNECT] = "connect",
+        [NANO_REST_PHASE_SEND] = "send",
+        [NANO_REST_PHASE_FIRST_BYTE] = "first_byte",
+        [NANO_REST_PHASE_BODY] = "body",
+        [NANO_REST_PHASE_PARSE] = "parse",
+        [NANO_REST_PHASE_TOTAL] = "total",
+    };
+    nano_rest_stats_t stats;
+    nano_rest_get_stats(&stats);
+    for( int p = 0; p < NANO_REST_PHASE_COUNT; p++ ) {
+        const nano_rest_latency_t *l = &stats.phase[p];
+        printf("    %-10s %8u samples  min %7u  p50 %7u  p95 %7u  p99 %7u"
+                "  max %7u us\n", names[p], l->count, l->min_us, l->p50_us,
+                l->p95_us, l->p99_us, l->max_us);
+    }
+
+    /* Counters since the last report */
+    static nano_rest_trace_t last;
+    nano_rest_trace_t t;
+    nano_rest_get_trace(&t);
+    printf("    requests %u  failures %u  timeouts %u  cancels %u  dns %u (cached %u)"
+            "  connects %u  reuses %u  retries %u  failovers %u  hedges %u (won %u)"
+            "  sent %u B"
+            "  received %u B\n",
+            t.requests - last.requests, t.failures - last.failures,
+            t.timeouts - last.timeouts, t.cancels - last.cancels,
+            t.dns_lookups - last.dns_lookups,
+            t.dns_cache_hits - last.dns_cache_hits,
+            t.connects - last.connects, t.conn_reuses - last.conn_reuses,
+            t.conn_retries - last.conn_retries, t.failovers - last.failovers,
+            t.hedges - last.hedges, t.hedge_wins - last.hedge_wins,
+            t.bytes_sent - last.bytes_sent,
+            t.bytes_received - last.bytes_received);
+    last = t;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [-n requests] [-c concurrency] [-s size[,size...]]\n"
+            "          [-b batch] [-d delay_ms] [-t] [-k] [-S] [-v]\n"
+            "  -n  requests per response size (default 2000)\n"
+            "  -c  concurrent callers (default 1)\n"
+            "  -s  response body sizes in bytes (default 64,1024,8192,32768)\n"
+            "  -b  pipeline this many requests per call; latencies are per\n"
+            "      call (default 1)\n"
+            "  -d  simulated node processing time (default 0)\n"
+            "  -t  chunked transfer encoding instead of Content-Length\n"
+            "  -k  mock node closes the connection after every response\n"
+            "  -S  print nano_rest's per-phase latency statistics and event\n"
+            "      counters\n"
+            "  -v  nano_rest INFO logging\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    int n_requests = 2000;
+    int concurrency = 1;
+    int batch = 1;
+    bool phase_stats = false;
+    char sizes_default[] = "64,1024,8192,32768";
+    char *sizes = sizes_default;
+    mock_node_config_t config = {
+        .chunk_size = 512,
+        .keep_alive = true,
+    };
+    int opt;
+
+    while( -1 != (opt = getopt(argc, argv, "n:c:s:b:d:tkSvh")) ) {
+        switch( opt ) {
+            case 'n': n_requests = atoi(optarg); break;
+            case 'c': concurrency = atoi(optarg); break;
+            case 's': sizes = optarg; break;
+            case 'b': batch = atoi(optarg); break;
+            case 'd': config.delay_ms = atoi(optarg); break;
+            case 't': config.chunked = true; break;
+            case 'k': config.keep_alive = false; break;
+            case 'S': phase_stats = true; break;
+            case 'v': esp_log_level_set("*", ESP_LOG_INFO); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if( n_requests < 1 || concurrency < 1 || batch < 1 ) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* lwIP has no SIGPIPE; a write to a connection the node dropped must
+     * fail with EPIPE here too */
+    signal(SIGPIPE, SIG_IGN);
+
+    uint16_t port = mock_node_start(&config);
+    if( 0 == port ) {
+        fprintf(stderr, "Unable to start mock node\n");
+        return 1;
+    }
+    nano_rest_set_remote_domain("127.0.0.1");
+    nano_rest_set_remote_port(port);
+    nano_rest_set_remote_path("/");
+
+    printf("%10s %8s %7s %10s %10s %10s %12s %6s\n", "body_B", "requests",
+            "errors", "req/s", "p50_us", "p99_us", "peak_heap_B", "conns");
+    for( char *tok = strtok(sizes, ","); NULL != tok; tok = strtok(NULL, ",") ) {
+        config.body_size = strtoul(tok, NULL, 10);
+        mock_node_configure(&config);
+
+        int calls = (n_requests + batch - 1) / batch;
+        int per_worker = (calls + concurrency - 1) / concurrency;
+        bench_worker_t *workers = calloc(concurrency, sizeof(bench_worker_t));
+        uint64_t *latencies = calloc((size_t)per_worker * concurrency,
+                sizeof(uint64_t));
+        for( int i = 0; i < concurrency; i++ ) {
+            workers[i].n_requests = per_worker;
+            workers[i].batch = batch;
+            workers[i].result_buf_len = config.body_size + 1;
+            workers[i].result_buf = malloc(workers[i].result_buf_len * batch);
+            workers[i].items = calloc(batch, sizeof(nano_rest_batch_item_t));
+            for( int j = 0; j < batch; j++ ) {
+                workers[i].items[j].post_data = (char *)BENCH_RPC;
+                workers[i].items[j].result_data_buf =
+                        &workers[i].result_buf[j * workers[i].result_buf_len];
+                workers[i].items[j].result_data_buf_len =
+                        workers[i].result_buf_len;
+            }
+            workers[i].latencies_ns = &latencies[(size_t)i * per_worker];
+        }
+
+        /* Warm up the worker tasks, DNS cache and connection pool */
+        network_get_data((char *)BENCH_RPC,
+                workers[0].result_buf, workers[0].result_buf_len);
+
+        uint32_t conns = mock_node_connections();
+        size_t heap_base = heap_trace_live();
+        heap_trace_reset_peak();
+        nano_rest_reset_stats();
+        uint64_t start = now_ns();
+        for( int i = 0; i < concurrency; i++ ) {
+            pthread_create(&workers[i].thread, NULL, bench_worker, &workers[i]);
+        }
+        int errors = 0;
+        for( int i = 0; i < concurrency; i++ ) {
+            pthread_join(workers[i].thread, NULL);
+            errors += workers[i].errors;
+        }
+        uint64_t elapsed = now_ns() - start;
+        size_t heap_peak = heap_trace_peak() - heap_base;
+        conns = mock_node_connections() - conns;
+
+        size_t total = (size_t)per_worker * concurrency;
+        qsort(latencies, total, sizeof(uint64_t), cmp_u64);
+        printf("%10zu %8zu %7d %10.0f %10.1f %10.1f %12zu %6u\n",
+                config.body_size, total * batch, errors,
+                total * batch / (elapsed / 1e9),
+                latencies[total / 2] / 1e3,
+                latencies[(total * 99) / 100] / 1e3,
+                heap_peak, conns);
+        if( phase_stats ) {
+            print_stats();
+        }
+
+        for( int i = 0; i < concurrency; i++ ) {
+            free(workers[i].result_buf);
+            free(workers[i].items);
+        }
+        free(workers);
+        free(latencies);
+    }
+    return 0;
+}
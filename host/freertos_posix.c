@@ -0,0 +1,242 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* FreeRTOS tasks, semaphores and queues mapped onto pthreads so nano_rest
+ * can be built and profiled on a workstation. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    (void)tag;
+    host_log_level = level;
+}
+
+/* Converts a relative tick timeout into an absolute CLOCK_MONOTONIC time */
+static void deadline(TickType_t ticks, struct timespec *ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if( ts->tv_nsec >= 1000000000L ) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Waits on cond until pred() holds or ticks elapse; m must be held */
+#define WAIT_UNTIL(cond, m, ticks, pred) do {                               \
+        struct timespec ts;                                                 \
+        int rc = 0;                                                         \
+        deadline(ticks, &ts);                                               \
+        while( !(pred) && 0 == rc ) {                                       \
+            if( portMAX_DELAY == (ticks) ) {                                \
+                pthread_cond_wait(cond, m);                                 \
+            }                                                               \
+            else {                                                          \
+                rc = pthread_cond_timedwait(cond, m, &ts);                  \
+            }                                                               \
+        }                                                                   \
+    } while(0)
+
+/****************************************************************************
+ * Tasks
+ ****************************************************************************/
+
+typedef struct task_start_t {
+    TaskFunction_t fn;
+    void *args;
+} task_start_t;
+
+static void *task_entry(void *arg) {
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.fn(start.args);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+        void *args, UBaseType_t priority, TaskHandle_t *handle) {
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if( NULL == start ) {
+        return pdFAIL;
+    }
+    start->fn = fn;
+    start->args = args;
+    if( 0 != pthread_create(&thread, NULL, task_entry, start) ) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if( NULL != handle ) {
+        *handle = (TaskHandle_t) thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    if( NULL == handle ) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {
+        .tv_sec = ticks / 1000,
+        .tv_nsec = (long)(ticks % 1000) * 1000000L,
+    };
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/****************************************************************************
+ * Semaphores
+ ****************************************************************************/
+
+struct host_semaphore_t {
+    pthread_mutex_t m;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    SemaphoreHandle_t sem = calloc(1, sizeof(struct host_semaphore_t));
+    if( NULL == sem ) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->m, NULL);
+    cond_init(&sem->cond);
+    sem->max = max;
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    BaseType_t res = pdFALSE;
+    pthread_mutex_lock(&sem->m);
+    WAIT_UNTIL(&sem->cond, &sem->m, ticks, sem->count > 0);
+    if( sem->count > 0 ) {
+        sem->count--;
+        res = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->m);
+    return res;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    BaseType_t res = pdFALSE;
+    pthread_mutex_lock(&sem->m);
+    if( sem->count < sem->max ) {
+        sem->count++;
+        res = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->m);
+    return res;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(&sem->m);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+/****************************************************************************
+ * Queues
+ ****************************************************************************/
+
+struct host_queue_t {
+    pthread_mutex_t m;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    char items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = calloc(1,
+            sizeof(struct host_queue_t) + length * item_size);
+    if( NULL == queue ) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->m, NULL);
+    cond_init(&queue->cond);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    BaseType_t res = pdFALSE;
+    pthread_mutex_lock(&queue->m);
+    WAIT_UNTIL(&queue->cond, &queue->m, ticks, queue->count < queue->length);
+    if( queue->count < queue->length ) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        res = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->m);
+    return res;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    BaseType_t res = pdFALSE;
+    pthread_mutex_lock(&queue->m);
+    WAIT_UNTIL(&queue->cond, &queue->m, ticks, queue->count > 0);
+    if( queue->count > 0 ) {
+        memcpy(item, &queue->items[queue->head * queue->item_size],
+                queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        res = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->m);
+    return res;
+}
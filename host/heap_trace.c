@@ -0,0 +1,80 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Tracks live and peak heap usage. Linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free so every
+ * allocation made by nano_rest and the benchmark is counted. */
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "heap_trace.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_live = 0;
+static size_t heap_peak = 0;
+
+static void heap_add(void *ptr) {
+    if( NULL == ptr ) {
+        return;
+    }
+    size_t live = __atomic_add_fetch(&heap_live, malloc_usable_size(ptr),
+            __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+    while( live > peak && !__atomic_compare_exchange_n(&heap_peak, &peak,
+            live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) {
+    }
+}
+
+static void heap_sub(void *ptr) {
+    if( NULL == ptr ) {
+        return;
+    }
+    __atomic_sub_fetch(&heap_live, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    void *ptr = __real_calloc(nmemb, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t old_size = (NULL == ptr) ? 0 : malloc_usable_size(ptr);
+    void *new_ptr = __real_realloc(ptr, size);
+    if( NULL != new_ptr || 0 == size ) {
+        __atomic_sub_fetch(&heap_live, old_size, __ATOMIC_RELAXED);
+        heap_add(new_ptr);
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr) {
+    heap_sub(ptr);
+    __real_free(ptr);
+}
+
+size_t heap_trace_live(void) {
+    return __atomic_load_n(&heap_live, __ATOMIC_RELAXED);
+}
+
+size_t heap_trace_peak(void) {
+    return __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+}
+
+void heap_trace_reset_peak(void) {
+    __atomic_store_n(&heap_peak, heap_trace_live(), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,16 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_HEAP_TRACE_H__
+#define __HOST_HEAP_TRACE_H__
+
+#include <stddef.h>
+
+size_t heap_trace_live(void);
+size_t heap_trace_peak(void);
+/* Starts a new measurement window at the current live usage */
+void heap_trace_reset_peak(void);
+
+#endif
@@ -0,0 +1,12 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_ESP_EVENT_LOOP_H__
+#define __HOST_ESP_EVENT_LOOP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#endif
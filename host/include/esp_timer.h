@@ -0,0 +1,14 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+/* Microseconds since start-up, from CLOCK_MONOTONIC */
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,9 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_LWIP_DNS_H__
+#define __HOST_LWIP_DNS_H__
+
+#endif
@@ -0,0 +1,12 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_LWIP_SYS_H__
+#define __HOST_LWIP_SYS_H__
+
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+#endif
@@ -0,0 +1,115 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Stand-in for the ESP-IDF generated sdkconfig.h; mirrors the Kconfig
+ * defaults. Override any of them with -D on the make command line. */
+
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#ifndef CONFIG_NANO_REST_DOMAIN
+#define CONFIG_NANO_REST_DOMAIN "yapraiwallet.space"
+#endif
+#ifndef CONFIG_NANO_REST_PATH
+#define CONFIG_NANO_REST_PATH "/api"
+#endif
+#ifndef CONFIG_NANO_REST_PORT
+#define CONFIG_NANO_REST_PORT 5523
+#endif
+#ifndef CONFIG_NANO_REST_MAX_ENDPOINTS
+#define CONFIG_NANO_REST_MAX_ENDPOINTS 4
+#endif
+#ifndef CONFIG_NANO_REST_BACKOFF_MIN
+#define CONFIG_NANO_REST_BACKOFF_MIN 1
+#endif
+#ifndef CONFIG_NANO_REST_BACKOFF_MAX
+#define CONFIG_NANO_REST_BACKOFF_MAX 60
+#endif
+#ifndef CONFIG_NANO_REST_HEDGE
+#define CONFIG_NANO_REST_HEDGE 0
+#endif
+#ifndef CONFIG_NANO_REST_HEDGE_DELAY
+#define CONFIG_NANO_REST_HEDGE_DELAY 0
+#endif
+#ifndef CONFIG_NANO_REST_HEDGE_DELAY_MIN
+#define CONFIG_NANO_REST_HEDGE_DELAY_MIN 50
+#endif
+#ifndef CONFIG_NANO_REST_RECEIVE_TIMEOUT
+#define CONFIG_NANO_REST_RECEIVE_TIMEOUT 15
+#endif
+#ifndef CONFIG_NANO_REST_CONNECT_TIMEOUT
+#define CONFIG_NANO_REST_CONNECT_TIMEOUT 5
+#endif
+#ifndef CONFIG_NANO_REST_SEND_TIMEOUT
+#define CONFIG_NANO_REST_SEND_TIMEOUT 5
+#endif
+#ifndef CONFIG_NANO_REST_FIRST_BYTE_TIMEOUT
+#define CONFIG_NANO_REST_FIRST_BYTE_TIMEOUT 10
+#endif
+#ifndef CONFIG_NANO_REST_DNS_CACHE_TTL
+#define CONFIG_NANO_REST_DNS_CACHE_TTL 300
+#endif
+#ifndef CONFIG_NANO_REST_CACHE
+#define CONFIG_NANO_REST_CACHE 0
+#endif
+#ifndef CONFIG_NANO_REST_CACHE_SIZE
+#define CONFIG_NANO_REST_CACHE_SIZE 8192
+#endif
+#ifndef CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE
+#define CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE 512
+#endif
+#ifndef CONFIG_NANO_REST_RECEIVE_MAX_SIZE
+#define CONFIG_NANO_REST_RECEIVE_MAX_SIZE 65536
+#endif
+#ifndef CONFIG_NANO_REST_HEADER_BUF_SIZE
+#define CONFIG_NANO_REST_HEADER_BUF_SIZE 1024
+#endif
+#ifndef CONFIG_NANO_REST_KEEP_ALIVE
+#define CONFIG_NANO_REST_KEEP_ALIVE 1
+#endif
+#ifndef CONFIG_NANO_REST_TCP_NODELAY
+#define CONFIG_NANO_REST_TCP_NODELAY 1
+#endif
+#ifndef CONFIG_NANO_REST_POOL_SIZE
+#define CONFIG_NANO_REST_POOL_SIZE 4
+#endif
+#ifndef CONFIG_NANO_REST_POOL_IDLE_TIMEOUT
+#define CONFIG_NANO_REST_POOL_IDLE_TIMEOUT 30
+#endif
+#ifndef CONFIG_NANO_REST_PIPELINE_DEPTH
+#define CONFIG_NANO_REST_PIPELINE_DEPTH 8
+#endif
+#ifndef CONFIG_NANO_REST_COALESCE_WINDOW
+#define CONFIG_NANO_REST_COALESCE_WINDOW 20
+#endif
+#ifndef CONFIG_NANO_REST_COALESCE_MAX
+#define CONFIG_NANO_REST_COALESCE_MAX 16
+#endif
+#ifndef CONFIG_NANO_REST_MAX_INFLIGHT
+#define CONFIG_NANO_REST_MAX_INFLIGHT 4
+#endif
+#ifndef CONFIG_NANO_REST_TASK_STACK_SIZE
+#define CONFIG_NANO_REST_TASK_STACK_SIZE 16000
+#endif
+#ifndef CONFIG_NANO_REST_TASK_PRIORITY
+#define CONFIG_NANO_REST_TASK_PRIORITY 10
+#endif
+#ifndef CONFIG_NANO_REST_QUEUE_LENGTH
+#define CONFIG_NANO_REST_QUEUE_LENGTH 4
+#endif
+#ifndef CONFIG_NANO_REST_LOG_LEVEL
+#define CONFIG_NANO_REST_LOG_LEVEL 3
+#endif
+#ifndef CONFIG_NANO_REST_TRACE
+#define CONFIG_NANO_REST_TRACE 1
+#endif
+#ifndef CONFIG_NANO_REST_STATS
+#define CONFIG_NANO_REST_STATS 1
+#endif
+#ifndef CONFIG_NANO_REST_STATS_WINDOW
+#define CONFIG_NANO_REST_STATS_WINDOW 60
+#endif
+
+#endif
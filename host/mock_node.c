@@ -0,0 +1,319 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Minimal loopback stand-in for a Nano node's RPC server. Every POST gets a
+ * JSON body of the configured size. One thread per connection; nothing is
+ * allocated per request so the heap numbers belong to nano_rest alone. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "picohttpparser.h"
+#include "mock_node.h"
+
+static mock_node_config_t mock_config;
+static pthread_mutex_t mock_config_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t mock_connections = 0;
+
+static int write_all(int s, const char *buf, size_t len) {
+    while( len > 0 ) {
+        ssize_t r = send(s, buf, len, MSG_NOSIGNAL);
+        if( r <= 0 ) {
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/* Writes len bytes of a JSON body, generated on the fly */
+static int write_body(int s, size_t len, size_t *written, size_t total) {
+    static const char prefix[] = "{\"count\":\"12345678\",\"unchecked\":\"0\",\"pad\":\"";
+    char buf[4096];
+    while( len > 0 ) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        for( size_t i = 0; i < n; i++ ) {
+            size_t pos = *written + i;
+            if( pos < sizeof(prefix) - 1 ) {
+                buf[i] = prefix[pos];
+            }
+            else if( pos == total - 2 ) {
+                buf[i] = '"';
+            }
+            else if( pos == total - 1 ) {
+                buf[i] = '}';
+            }
+            else {
+                buf[i] = 'a' + pos % 26;
+            }
+        }
+        if( 0 != write_all(s, buf, n) ) {
+            return -1;
+        }
+        *written += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int respond(int s, const mock_node_config_t *config) {
+    char hdr[256];
+    size_t written = 0;
+    int hdr_len;
+
+    if( config->chunked ) {
+        hdr_len = snprintf(hdr, sizeof(hdr),
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/json\r\n"
+                "Transfer-Encoding: chunked\r\n"
+                "Connection: %s\r\n"
+                "\r\n", config->keep_alive ? "keep-alive" : "close");
+        if( 0 != write_all(s, hdr, hdr_len) ) {
+            return -1;
+        }
+        size_t chunk_size = config->chunk_size ? config->chunk_size : 256;
+        while( written < config->body_size ) {
+            size_t n = config->body_size - written;
+            if( n > chunk_size ) {
+                n = chunk_size;
+            }
+            hdr_len = snprintf(hdr, sizeof(hdr), "%zx\r\n", n);
+            if( 0 != write_all(s, hdr, hdr_len) ||
+                    0 != write_body(s, n, &written, config->body_size) ||
+                    0 != write_all(s, "\r\n", 2) ) {
+                return -1;
+            }
+        }
+        return write_all(s, "0\r\n\r\n", 5);
+    }
+    hdr_len = snprintf(hdr, sizeof(hdr),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: %s\r\n"
+            "\r\n", config->body_size,
+            config->keep_alive ? "keep-alive" : "close");
+    if( 0 != write_all(s, hdr, hdr_len) ) {
+        return -1;
+    }
+    return write_body(s, config->body_size, &written, config->body_size);
+}
+
+static void *connection_thread(void *arg) {
+    int s = (int)(intptr_t)arg;
+    char buf[8192];
+    size_t buf_len = 0;
+    int one = 1;
+
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    for( ;; ) {
+        const char *method, *path;
+        size_t method_len, path_len, num_headers;
+        struct phr_header headers[32];
+        int minor_version;
+        int header_len = -2;
+
+        if( buf_len > 0 ) {
+            // Pipelined request left over from the last read
+            num_headers = sizeof(headers) / sizeof(headers[0]);
+            header_len = phr_parse_request(buf, buf_len, &method, &method_len,
+                    &path, &path_len, &minor_version, headers, &num_headers, 0);
+        }
+        while( -2 == header_len ) {
+            size_t last_len = buf_len;
+            ssize_t r = read(s, &buf[buf_len], sizeof(buf) - buf_len);
+            if( r <= 0 ) {
+                goto exit;
+            }
+            buf_len += r;
+            num_headers = sizeof(headers) / sizeof(headers[0]);
+            header_len = phr_parse_request(buf, buf_len, &method, &method_len,
+                    &path, &path_len, &minor_version, headers, &num_headers,
+                    last_len);
+            if( -2 == header_len && buf_len == sizeof(buf) ) {
+                goto exit;
+            }
+        }
+        if( header_len < 0 ) {
+            goto exit;
+        }
+
+        /* Discard the request body */
+        size_t content_length = 0;
+        for( size_t i = 0; i < num_headers; i++ ) {
+            if( 14 == headers[i].name_len &&
+                    0 == strncasecmp(headers[i].name, "Content-Length", 14) ) {
+                content_length = strtoul(headers[i].value, NULL, 10);
+            }
+        }
+        size_t consumed = header_len;
+        while( buf_len - consumed < content_length ) {
+            content_length -= buf_len - consumed;
+            consumed = buf_len = 0;
+            ssize_t r = read(s, buf, sizeof(buf));
+            if( r <= 0 ) {
+                goto exit;
+            }
+            buf_len = r;
+        }
+        consumed += content_length;
+        memmove(buf, &buf[consumed], buf_len - consumed);
+        buf_len -= consumed;
+
+        mock_node_config_t config;
+        pthread_mutex_lock(&mock_config_lock);
+        config = mock_config;
+        pthread_mutex_unlock(&mock_config_lock);
+
+        if( config.delay_ms > 0 ) {
+            struct timespec ts = {
+                .tv_sec = config.delay_ms / 1000,
+                .tv_nsec = (long)(config.delay_ms % 1000) * 1000000L,
+            };
+            nanosleep(&ts, NULL);
+        }
+        bool keep_alive = config.keep_alive && 1 == minor_version;
+        config.keep_alive = keep_alive;
+        if( 0 != respond(s, &config) || !keep_alive ) {
+            goto exit;
+        }
+    }
+exit:
+    close(s);
+    return NULL;
+}
+
+static void *accept_thread(void *arg) {
+    int listener = (int)(intptr_t)arg;
+    for( ;; ) {
+        int s = accept(listener, NULL, NULL);
+        if( s < 0 ) {
+            continue;
+        }
+        __atomic_add_fetch(&mock_connections, 1, __ATOMIC_RELAXED);
+        pthread_t thread;
+        if( 0 != pthread_create(&thread, NULL, connection_thread,
+                (void *)(intptr_t)s) ) {
+            close(s);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+/* Opens a loopback listener on a free port. Returns the socket, or -1. */
+static int mock_listen(uint16_t *port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    int one = 1;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if( listener < 0 ) {
+        return -1;
+    }
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if( 0 != bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+            0 != listen(listener, 64) ||
+            0 != getsockname(listener, (struct sockaddr *)&addr, &addr_len) ) {
+        close(listener);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return listener;
+}
+
+uint16_t mock_node_start(const mock_node_config_t *config) {
+    uint16_t port;
+    pthread_t thread;
+
+    mock_node_configure(config);
+    int listener = mock_listen(&port);
+    if( listener < 0 ) {
+        return 0;
+    }
+    if( 0 != pthread_create(&thread, NULL, accept_thread,
+            (void *)(intptr_t)listener) ) {
+        close(listener);
+        return 0;
+    }
+    pthread_detach(thread);
+    return port;
+}
+
+typedef struct faulty_node_t {
+    int listener;
+    uint32_t delay_ms;
+    const char *reply;
+} faulty_node_t;
+
+/* Serves one connection at a time; the node is only meant to be hit by a
+ * request or two */
+static void *faulty_thread(void *arg) {
+    faulty_node_t *node = arg;
+    for( ;; ) {
+        int s = accept(node->listener, NULL, NULL);
+        if( s < 0 ) {
+            continue;
+        }
+        char buf[1024];
+        if( read(s, buf, sizeof(buf)) > 0 ) {
+            usleep(node->delay_ms * 1000);
+            if( NULL != node->reply ) {
+                write_all(s, node->reply, strlen(node->reply));
+            }
+        }
+        close(s);
+    }
+    return NULL;
+}
+
+uint16_t mock_node_start_faulty(uint32_t delay_ms, const char *reply) {
+    uint16_t port;
+    pthread_t thread;
+
+    faulty_node_t *node = malloc(sizeof(faulty_node_t));
+    if( NULL == node ) {
+        return 0;
+    }
+    node->delay_ms = delay_ms;
+    node->reply = reply;
+    node->listener = mock_listen(&port);
+    if( node->listener < 0 ) {
+        free(node);
+        return 0;
+    }
+    if( 0 != pthread_create(&thread, NULL, faulty_thread, node) ) {
+        close(node->listener);
+        free(node);
+        return 0;
+    }
+    pthread_detach(thread);
+    return port;
+}
+
+void mock_node_configure(const mock_node_config_t *config) {
+    pthread_mutex_lock(&mock_config_lock);
+    mock_config = *config;
+    pthread_mutex_unlock(&mock_config_lock);
+}
+
+uint32_t mock_node_connections(void) {
+    return __atomic_load_n(&mock_connections, __ATOMIC_RELAXED);
+}
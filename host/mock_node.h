@@ -0,0 +1,34 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+#ifndef __HOST_MOCK_NODE_H__
+#define __HOST_MOCK_NODE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shape of the responses served by the mock node */
+typedef struct mock_node_config_t {
+    size_t body_size;   // bytes of JSON body per response
+    bool chunked;       // Transfer-Encoding: chunked instead of Content-Length
+    size_t chunk_size;  // bytes per chunk when chunked
+    bool keep_alive;    // honour HTTP/1.1 persistent connections
+    uint32_t delay_ms;  // simulated node processing time
+} mock_node_config_t;
+
+/* Starts a loopback HTTP server that answers every POST like a Nano node
+ * RPC. Returns the port it listens on, or 0 on failure. */
+uint16_t mock_node_start(const mock_node_config_t *config);
+/* Applies to requests arriving from now on */
+void mock_node_configure(const mock_node_config_t *config);
+/* Number of TCP connections accepted so far */
+uint32_t mock_node_connections(void);
+/* Starts a loopback node of its own that reads a request, waits delay_ms
+ * and then sends reply and closes the connection. Without a reply it just
+ * closes the connection. Returns the port it listens on, or 0 on failure. */
+uint16_t mock_node_start_faulty(uint32_t delay_ms, const char *reply);
+
+#endif
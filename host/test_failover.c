@@ -0,0 +1,115 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Failover on responses that are not a success: an error status counts as
+ * a failure of the node that sent it, however quickly it came back. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "esp_log.h"
+#include "nano_rest.h"
+#include "mock_node.h"
+
+static const char READ_RPC[] = "{\"action\":\"block_count\"}";
+static const char WRITE_RPC[] = "{\"action\":\"process\",\"block\":\"{}\"}";
+// A read-only action nested in the block comes first
+static const char NESTED_WRITE_RPC[] =
+        "{\"json_block\":\"true\",\"block\":{\"action\":\"block_count\"},"
+        "\"action\":\"process\"}";
+
+static const char BAD_GATEWAY[] =
+        "HTTP/1.1 502 Bad Gateway\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: 38\r\n"
+        "\r\n"
+        "<html><h1>502 Bad Gateway</h1></html>\n";
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if( !(cond) ) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+/* Sends requests to primary first, then to backup */
+static void use_nodes(uint16_t primary, uint16_t backup) {
+    nano_rest_set_remote_domain("127.0.0.1");
+    nano_rest_set_remote_port(primary);
+    nano_rest_set_remote_path("/");
+    nano_rest_clear_endpoints();
+    nano_rest_add_endpoint("127.0.0.1", backup, "/");
+}
+
+static int get(const char *rpc, char *buf, size_t buf_len,
+        nano_rest_trace_t *delta) {
+    nano_rest_trace_t before, after;
+    memset(buf, 0, buf_len);
+    nano_rest_get_trace(&before);
+    int r = network_get_data((char *)rpc, buf, buf_len);
+    nano_rest_get_trace(&after);
+    delta->failovers = after.failovers - before.failovers;
+    delta->failures = after.failures - before.failures;
+    return r;
+}
+
+/* A read-only RPC moves on to the next node, which is preferred from then
+ * on even though the error page came back faster */
+static void test_error_status_fails_over(uint16_t backup) {
+    char buf[256];
+    nano_rest_trace_t delta;
+    int failed = failures;
+
+    use_nodes(mock_node_start_faulty(0, BAD_GATEWAY), backup);
+    int r = get(READ_RPC, buf, sizeof(buf), &delta);
+    CHECK(0 == r);
+    CHECK(1 == delta.failovers);
+    CHECK(NULL != strstr(buf, "\"count\""));
+    r = get(READ_RPC, buf, sizeof(buf), &delta);
+    CHECK(0 == r);
+    CHECK(0 == delta.failovers);
+    printf("%s error status fails over: returned %d, %zu bytes\n",
+            failures > failed ? "not ok" : "ok", r, strlen(buf));
+}
+
+/* Anything else may have taken effect, so it is not sent again */
+static void test_error_status_fails_write(const char *rpc, uint16_t backup) {
+    char buf[256];
+    nano_rest_trace_t delta;
+    int failed = failures;
+
+    use_nodes(mock_node_start_faulty(0, BAD_GATEWAY), backup);
+    int r = get(rpc, buf, sizeof(buf), &delta);
+    CHECK(-1 == r);
+    CHECK(0 == delta.failovers);
+    CHECK(1 == delta.failures);
+    CHECK(NULL == strstr(buf, "Bad Gateway"));
+    printf("%s error status fails a write: %s returned %d\n",
+            failures > failed ? "not ok" : "ok", rpc, r);
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    mock_node_config_t config = {
+        .body_size = 64,
+        .keep_alive = true,
+    };
+    uint16_t backup = mock_node_start(&config);
+    if( 0 == backup ) {
+        printf("FAIL unable to start the mock node\n");
+        return 1;
+    }
+
+    test_error_status_fails_over(backup);
+    test_error_status_fails_write(WRITE_RPC, backup);
+    test_error_status_fails_write(NESTED_WRITE_RPC, backup);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Hedging against nodes that fail after the copy of a request has gone
+ * out: the copy has to take the request over and deliver its response,
+ * failing over itself if need be. Built with hedging enabled, see the test
+ * target in the Makefile. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "esp_log.h"
+#include "nano_rest.h"
+#include "mock_node.h"
+
+#define FAIL_AFTER_MS (3 * CONFIG_NANO_REST_HEDGE_DELAY)
+#define HEDGE_FAIL_AFTER_MS (6 * CONFIG_NANO_REST_HEDGE_DELAY)
+#define BACKUP_DELAY_MS (4 * CONFIG_NANO_REST_HEDGE_DELAY)
+
+static const char TEST_RPC[] = "{\"action\":\"block_count\"}";
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if( !(cond) ) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+/* Sends requests to primary first, then to the nodes in backups in order */
+static void use_nodes(uint16_t primary, const uint16_t *backups, int n) {
+    nano_rest_set_remote_domain("127.0.0.1");
+    nano_rest_set_remote_port(primary);
+    nano_rest_set_remote_path("/");
+    nano_rest_clear_endpoints();
+    for( int i = 0; i < n; i++ ) {
+        nano_rest_add_endpoint("127.0.0.1", backups[i], "/");
+    }
+}
+
+static void test_primary_fails_after_hedge(uint16_t backup) {
+    char buf[256];
+    nano_rest_trace_t before, after;
+    int failed = failures;
+
+    use_nodes(mock_node_start_faulty(FAIL_AFTER_MS, NULL), &backup, 1);
+    memset(buf, 0, sizeof(buf));
+    nano_rest_get_trace(&before);
+    int r = network_get_data((char *)TEST_RPC, buf, sizeof(buf));
+    nano_rest_get_trace(&after);
+    CHECK(0 == r);
+    CHECK(1 == after.hedges - before.hedges);
+    CHECK(NULL != strstr(buf, "\"count\""));
+    printf("%s primary fails after hedge: returned %d, %zu bytes\n",
+            failures > failed ? "not ok" : "ok", r, strlen(buf));
+}
+
+/* The hedge takes the job over, then fails itself and has to fail over to
+ * a third node, still receiving into a buffer of its own */
+static void test_hedge_fails_over(uint16_t backup) {
+    char buf[256];
+    nano_rest_trace_t before, after;
+    int failed = failures;
+
+    uint16_t backups[] = {
+        mock_node_start_faulty(HEDGE_FAIL_AFTER_MS, NULL), backup
+    };
+    use_nodes(mock_node_start_faulty(FAIL_AFTER_MS, NULL), backups, 2);
+    memset(buf, 0, sizeof(buf));
+    nano_rest_get_trace(&before);
+    int r = network_get_data((char *)TEST_RPC, buf, sizeof(buf));
+    nano_rest_get_trace(&after);
+    CHECK(0 == r);
+    CHECK(1 == after.hedges - before.hedges);
+    CHECK(1 == after.failovers - before.failovers);
+    CHECK(NULL != strstr(buf, "\"count\""));
+    printf("%s hedge fails over after taking the job: returned %d, %zu bytes\n",
+            failures > failed ? "not ok" : "ok", r, strlen(buf));
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    mock_node_config_t config = {
+        .body_size = 64,
+        .keep_alive = true,
+        .delay_ms = BACKUP_DELAY_MS,
+    };
+    uint16_t backup = mock_node_start(&config);
+    if( 0 == backup ) {
+        printf("FAIL unable to start the mock node\n");
+        return 1;
+    }
+
+    test_primary_fails_after_hedge(backup);
+    test_hedge_fails_over(backup);
+    return failures ? 1 : 0;
+}
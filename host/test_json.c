@@ -0,0 +1,192 @@
+/* nano_rest - host port
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* The streaming JSON extractor behind nano_rest_post_extract, fed directly
+ * so that every split of the document into chunks can be tried */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "nano_rest.h"
+#include "nano_rest_json.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if( !(cond) ) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+/* Feeds doc in chunks of chunk bytes, as the socket might hand it over */
+static int extract(const char *doc, size_t chunk,
+        nano_rest_json_field_t *fields, size_t n_fields) {
+    json_parser_t parser;
+    size_t len = strlen(doc);
+    json_begin(&parser, fields, n_fields);
+    for( size_t off = 0; off < len; off += chunk ) {
+        json_feed(&parser, doc + off, (len - off < chunk) ? len - off : chunk);
+    }
+    return json_end(&parser);
+}
+
+static void test_nested(size_t chunk) {
+    static const char doc[] =
+            "{\"blocks\":{"
+                "\"AAAA\":{\"amount\":\"1000000\",\"source\":\"x\"},"
+                "\"BBBB\":{\"amount\":\"2\",\"source\":\"y\"}},"
+            "\"history\":[{\"height\":\"7\"},{\"height\":8}],"
+            "\"deep\":{\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":{\"h\":\"1\"}}}}}}}},"
+            "\"tail\":\"end\"}";
+    char keys[3][8];
+    uint64_t amounts[3], heights[3];
+    char tail[8];
+    nano_rest_json_field_t fields[] = {
+        {"blocks.*", NANO_REST_JSON_KEY, keys, sizeof(keys[0]), 3},
+        {"blocks.*.amount", NANO_REST_JSON_UINT64, amounts, 0, 3},
+        {"history.*.height", NANO_REST_JSON_UINT64, heights, 0, 3},
+        {"tail", NANO_REST_JSON_STRING, tail, sizeof(tail)},
+    };
+    int failed = failures;
+
+    CHECK(0 == extract(doc, chunk, fields, 4));
+    CHECK(2 == fields[0].count);
+    CHECK(0 == strcmp(keys[0], "AAAA") && 0 == strcmp(keys[1], "BBBB"));
+    CHECK(2 == fields[1].count);
+    CHECK(1000000 == amounts[0] && 2 == amounts[1]);
+    CHECK(2 == fields[2].count);
+    CHECK(7 == heights[0] && 8 == heights[1]);
+    CHECK(1 == fields[3].count);
+    CHECK(0 == strcmp(tail, "end"));
+    printf("%s nested paths, chunks of %zu\n",
+            failures > failed ? "not ok" : "ok", chunk);
+}
+
+static void test_types(size_t chunk) {
+    static const char doc[] =
+            "{\"s\":[\"a\",12,null,true,{\"x\":\"1\"},[\"2\"],\"b\"],"
+            "\"u\":[\"18446744073709551615\",3,null,\"x\",-1,1.5,false],"
+            "\"b\":[true,\"false\",null,1]}";
+    char s[4][4];
+    uint64_t u[4];
+    bool b[4];
+    nano_rest_json_field_t fields[] = {
+        {"s.*", NANO_REST_JSON_STRING, s, sizeof(s[0]), 4},
+        {"u.*", NANO_REST_JSON_UINT64, u, 0, 4},
+        {"b.*", NANO_REST_JSON_BOOL, b, 0, 4},
+    };
+    int failed = failures;
+
+    CHECK(0 == extract(doc, chunk, fields, 3));
+    CHECK(2 == fields[0].count);
+    CHECK(0 == strcmp(s[0], "a") && 0 == strcmp(s[1], "b"));
+    CHECK(2 == fields[1].count);
+    CHECK(UINT64_MAX == u[0] && 3 == u[1]);
+    CHECK(2 == fields[2].count);
+    CHECK(b[0] && !b[1]);
+    printf("%s wrong types skipped, chunks of %zu\n",
+            failures > failed ? "not ok" : "ok", chunk);
+}
+
+static void test_escapes(size_t chunk) {
+    static const char doc[] =
+            "{\"a\\\"b\":\"q\\\"\\\\\\/\\n\\t\",\"u\":\"x\\u00e9y\\uD83D\\uDE00z\"}";
+    char key[8], s[8], u[8];
+    nano_rest_json_field_t fields[] = {
+        {"*", NANO_REST_JSON_KEY, key, sizeof(key)},
+        {"a\"b", NANO_REST_JSON_STRING, s, sizeof(s)},
+        {"u", NANO_REST_JSON_STRING, u, sizeof(u)},
+    };
+    int failed = failures;
+
+    // Only the first member name fits into the one KEY slot
+    CHECK(-1 == extract(doc, chunk, fields, 3));
+    CHECK(1 == fields[0].count);
+    CHECK(0 == strcmp(key, "a\"b"));
+    CHECK(1 == fields[1].count);
+    CHECK(0 == strcmp(s, "q\"\\/\n\t"));
+    CHECK(1 == fields[2].count);
+    CHECK(0 == strcmp(u, "x?y??z"));
+    printf("%s escapes, chunks of %zu\n",
+            failures > failed ? "not ok" : "ok", chunk);
+}
+
+static void test_overflow(size_t chunk) {
+    char s[2][4];
+    uint64_t u[2];
+    nano_rest_json_field_t strings = {"*", NANO_REST_JSON_STRING, s,
+            sizeof(s[0]), 2};
+    nano_rest_json_field_t numbers = {"*", NANO_REST_JSON_UINT64, u, 0, 2};
+    int failed = failures;
+
+    // More matches than slots keeps the first ones
+    CHECK(-1 == extract("[\"a\",\"b\",\"c\"]", chunk, &strings, 1));
+    CHECK(2 == strings.count);
+    CHECK(0 == strcmp(s[0], "a") && 0 == strcmp(s[1], "b"));
+    CHECK(-1 == extract("[1,2,3]", chunk, &numbers, 1));
+    CHECK(2 == numbers.count);
+    CHECK(1 == u[0] && 2 == u[1]);
+
+    // A string needs room for its terminator
+    CHECK(-1 == extract("[\"abcd\",\"abc\"]", chunk, &strings, 1));
+    CHECK(1 == strings.count);
+    CHECK(0 == strcmp(s[0], "abc"));
+    CHECK(0 == extract("[\"abc\"]", chunk, &strings, 1));
+    CHECK(1 == strings.count);
+    printf("%s overflowing slots, chunks of %zu\n",
+            failures > failed ? "not ok" : "ok", chunk);
+}
+
+static void test_malformed(size_t chunk) {
+    static const char *docs[] = {
+        "",
+        "{",
+        "{\"a\":1",
+        "{\"a\":1]",
+        "[1,2}",
+        "{\"a\" 1}",
+        "{a:1}",
+        "{\"a\":1,}x",
+        "{\"a\":\"1\"} {}",
+        "{\"a\":\"\\x\"}",
+        "{\"a\":\"\\u12g4\"}",
+        "{\"a\":\"line\nbreak\"}",
+        "{\"a\":@}",
+    };
+    uint64_t u;
+    nano_rest_json_field_t field = {"a", NANO_REST_JSON_UINT64, &u};
+    int failed = failures;
+
+    for( size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++ ) {
+        if( -1 != extract(docs[i], chunk, &field, 1) ) {
+            printf("FAIL %s:%d: accepted %s\n", __FILE__, __LINE__, docs[i]);
+            failures++;
+        }
+    }
+    // Containers nested past what paths can address are still parsed
+    CHECK(0 == extract("[[[[[[[[[[1]]]]]]]]]]", chunk, &field, 1));
+    CHECK(0 == field.count);
+    CHECK(0 == extract(" 42 ", chunk, &field, 1));
+    printf("%s malformed input, chunks of %zu\n",
+            failures > failed ? "not ok" : "ok", chunk);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    // Whole, then split at every byte so that chunks end inside tokens
+    static const size_t chunks[] = {4096, 1, 3};
+    for( size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++ ) {
+        test_nested(chunks[i]);
+        test_types(chunks[i]);
+        test_escapes(chunks[i]);
+        test_overflow(chunks[i]);
+        test_malformed(chunks[i]);
+    }
+    return failures ? 1 : 0;
+}
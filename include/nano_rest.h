@@ -6,15 +6,208 @@ https://www.joltwallet.com/
 #ifndef __INCLUDE_REST_H__
 #define __INCLUDE_REST_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define RX_BUFFER_BYTES (1536)
 #define RECEIVE_POLLING_PERIOD_MS pdMS_TO_TICKS(10000)
 
+/* Identifies an asynchronous request; 0 is never a valid handle */
+typedef uint32_t nano_rest_handle_t;
+
+/* Called from the http_rest task exactly once per asynchronous request.
+ * status is 0 on success, -1 on failure or cancellation (body NULL).
+ * body is NUL-terminated and only valid for the duration of the call. */
+typedef void (*nano_rest_cb_t)(int status, char *body, size_t body_len,
+        void *ctx);
+
+/* Receives a piece of a streamed response body. Called from the http_rest
+ * task; data is only valid for the duration of the call. */
+typedef void (*nano_rest_chunk_cb_t)(const char *data, size_t len, void *ctx);
+
+/* One request of a batch. status is set to 0 once the response has been
+ * received into result_data_buf and -1 otherwise. */
+typedef struct nano_rest_batch_item_t {
+    char *post_data;
+    char *result_data_buf;
+    size_t result_data_buf_len;
+    int status;
+} nano_rest_batch_item_t;
+
+/* Per-account queries that nano_rest_query coalesces into plural RPCs */
+typedef enum nano_rest_query_t {
+    NANO_REST_QUERY_BALANCE = 0, // accounts_balances
+    NANO_REST_QUERY_FRONTIER,    // accounts_frontiers
+    NANO_REST_QUERY_PENDING,     // accounts_pending
+    NANO_REST_QUERY_BLOCK_INFO,  // blocks_info, key is a block hash
+} nano_rest_query_t;
+
+/* How nano_rest_post_extract stores the values of a field */
+typedef enum nano_rest_json_type_t {
+    NANO_REST_JSON_STRING = 0, // char[size], NUL-terminated, strings only
+    NANO_REST_JSON_UINT64,     // uint64_t, from a number or decimal string
+    NANO_REST_JSON_BOOL,       // bool, from true/false, quoted or not
+    NANO_REST_JSON_KEY,        // char[size], the member names '*' matched
+} nano_rest_json_type_t;
+
+/* A value to pick out of a response. path names members from the top
+ * level down separated by dots, e.g. "balance" or "blocks.*.amount"; '*'
+ * matches every member or array element. Each match is stored into the
+ * next of the max slots at dst, and count is set to the number stored.
+ * Values of the wrong type, null and containers are skipped. */
+typedef struct nano_rest_json_field_t {
+    const char *path;
+    nano_rest_json_type_t type;
+    void *dst;
+    size_t size; // bytes per slot, STRING and KEY only
+    size_t max;  // slots at dst; 0 means 1
+    size_t count;
+} nano_rest_json_field_t;
+
+/* Phases of a request timed by nano_rest_get_stats */
+typedef enum nano_rest_phase_t {
+    NANO_REST_PHASE_DNS = 0,    // name resolution, cache misses only
+    NANO_REST_PHASE_CONNECT,    // TCP handshake, new connections only
+    NANO_REST_PHASE_SEND,       // writing the request(s) out
+    NANO_REST_PHASE_FIRST_BYTE, // request sent to first byte of response
+    NANO_REST_PHASE_BODY,       // first byte to complete response
+    NANO_REST_PHASE_PARSE,      // time spent parsing headers and framing
+    NANO_REST_PHASE_TOTAL,      // request picked up to completed
+    NANO_REST_PHASE_COUNT
+} nano_rest_phase_t;
+
+/* Latency distribution of one phase. Percentiles are accurate to within
+ * about 20%. */
+typedef struct nano_rest_latency_t {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+} nano_rest_latency_t;
+
+typedef struct nano_rest_stats_t {
+    nano_rest_latency_t phase[NANO_REST_PHASE_COUNT];
+} nano_rest_stats_t;
+
+/* Event counters, see nano_rest_get_trace. They wrap around. */
+typedef struct nano_rest_trace_t {
+    uint32_t requests;       // picked up by the http_rest task
+    uint32_t failures;       // failed, timed out or cancelled
+    uint32_t timeouts;
+    uint32_t cancels;
+    uint32_t dns_lookups;
+    uint32_t dns_cache_hits;
+    uint32_t connects;       // new connections established
+    uint32_t conn_reuses;    // requests sent on a pooled connection
+    uint32_t conn_retries;   // stale pooled connections replaced
+    uint32_t failovers;      // requests moved to another node
+    uint32_t hedges;         // copies of slow requests sent to another node
+    uint32_t hedge_wins;     // of which answered first
+    uint32_t bytes_sent;
+    uint32_t bytes_received;
+} nano_rest_trace_t;
+
 int network_get_data(char *post_data, 
         char *result_data_buf, size_t result_data_buf_len);
+
+/* Like network_get_data, but always asks the node instead of answering from
+ * the response cache (CONFIG_NANO_REST_CACHE). The response still refreshes
+ * the cache. */
+int nano_rest_post_fresh(char *post_data,
+        char *result_data_buf, size_t result_data_buf_len);
+/* Empties the response cache */
+void nano_rest_cache_flush(void);
+
+/* Like network_get_data, but hands the body to on_body_chunk as it comes
+ * off the socket instead of collecting it, so responses of any size can be
+ * processed in bounded memory. Blocks until done; returns 0 on success. */
+int nano_rest_post_stream(char *post_data,
+        nano_rest_chunk_cb_t on_body_chunk, void *ctx);
+
+/* Like nano_rest_post_stream, but picks the n_fields fields (at most 32)
+ * out of the response as it arrives instead of handing it over, so no copy
+ * of the response is kept and nothing is allocated to parse it. Blocks
+ * until done; returns 0 if the response was well-formed JSON and every
+ * value found fitted into its field. */
+int nano_rest_post_extract(char *post_data, nano_rest_json_field_t *fields,
+        size_t n_fields);
+
+/* Sends n independent POSTs pipelined on one connection and reads the
+ * responses in order, so the batch costs about one round trip instead of
+ * one per request. Blocks until done; returns the number of requests that
+ * succeeded, or -1 if the batch could not be run. */
+int nano_rest_post_batch(nano_rest_batch_item_t *items, size_t n);
+
+/* Looks up one account (or block hash). Queries of the same kind made
+ * within CONFIG_NANO_REST_COALESCE_WINDOW ms of each other are sent as one
+ * plural RPC. result_data_buf receives this key's member of the reply,
+ * e.g. {"balance":"...","pending":"..."} for NANO_REST_QUERY_BALANCE.
+ * Blocks until done; returns 0 on success. */
+int nano_rest_query(nano_rest_query_t kind, const char *key,
+        char *result_data_buf, size_t result_data_buf_len);
+
+/* Typed RPCs. Each builds its request straight into the buffer it is sent
+ * from, adding the fixed parameters noted, and otherwise behaves like
+ * network_get_data. Accounts, hashes and counts may only contain letters,
+ * digits and underscores. */
+int nano_rest_account_balance(const char *account,
+        char *result_data_buf, size_t result_data_buf_len);
+// With representative and pending
+int nano_rest_account_info(const char *account,
+        char *result_data_buf, size_t result_data_buf_len);
+int nano_rest_account_representative(const char *account,
+        char *result_data_buf, size_t result_data_buf_len);
+int nano_rest_active_difficulty(char *result_data_buf,
+        size_t result_data_buf_len);
+int nano_rest_block_count(char *result_data_buf, size_t result_data_buf_len);
+// With json_block
+int nano_rest_block_info(const char *hash,
+        char *result_data_buf, size_t result_data_buf_len);
+// With source
+int nano_rest_pending(const char *account, uint32_t count,
+        char *result_data_buf, size_t result_data_buf_len);
+/* block_json is the block as a JSON object, sent with json_block */
+int nano_rest_process(const char *block_json,
+        char *result_data_buf, size_t result_data_buf_len);
+int nano_rest_work_generate(const char *hash,
+        char *result_data_buf, size_t result_data_buf_len);
+
+/* Queues a POST without blocking. Returns 0 if it could not be queued, in
+ * which case cb is not called. */
+nano_rest_handle_t nano_rest_post_async(char *post_data,
+        nano_rest_cb_t cb, void *ctx);
+/* Cancels an outstanding asynchronous request; its callback then reports
+ * -1. Handles of completed requests are ignored. */
+void nano_rest_cancel(nano_rest_handle_t handle);
 //void network_task(void *pvParameters);
 
+/* Latencies of the requests completed in the last one to two
+ * CONFIG_NANO_REST_STATS_WINDOW periods. All zero if CONFIG_NANO_REST_STATS
+ * is disabled. */
+void nano_rest_get_stats(nano_rest_stats_t *stats);
+void nano_rest_reset_stats(void);
+
+/* Copies the event counters. All zero if CONFIG_NANO_REST_TRACE is
+ * disabled. */
+void nano_rest_get_trace(nano_rest_trace_t *trace);
+
 void nano_rest_set_remote_domain(char *str);
 void nano_rest_set_remote_port(uint16_t port);
 void nano_rest_set_remote_path(char *str);
 
+/* Adds a node to send requests to besides the one set above, e.g. a
+ * backup. Each request goes to the node with the lowest smoothed response
+ * time among those that have not failed recently; a failing node is
+ * avoided for an exponentially growing backoff. Read-only RPCs that fail
+ * are retried on the next best node, and with CONFIG_NANO_REST_HEDGE one
+ * that is slow to answer is also sent there, the first response winning.
+ * Returns 0 on success, -1 if CONFIG_NANO_REST_MAX_ENDPOINTS nodes are
+ * already configured. */
+int nano_rest_add_endpoint(const char *domain, uint16_t port,
+        const char *path);
+/* Removes the nodes added with nano_rest_add_endpoint */
+void nano_rest_clear_endpoints(void);
+
 #endif
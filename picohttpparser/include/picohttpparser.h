@@ -57,6 +57,36 @@ int phr_parse_request(const char *buf, size_t len, const char **method, size_t *
 int phr_parse_response(const char *_buf, size_t len, int *minor_version, int *status, const char **msg, size_t *msg_len,
                        struct phr_header *headers, size_t *num_headers, size_t last_len);
 
+/* headers phr_parse_response_ex picks out while parsing */
+enum phr_known_header {
+    PHR_HEADER_CONNECTION,
+    PHR_HEADER_CONTENT_LENGTH,
+    PHR_HEADER_CONTENT_TYPE,
+    PHR_HEADER_KEEP_ALIVE,
+    PHR_HEADER_TRANSFER_ENCODING,
+    PHR_NUM_KNOWN_HEADERS
+};
+
+#define PHR_FLAG_CHUNKED 1               /* the last transfer coding is chunked */
+#define PHR_FLAG_CONNECTION_CLOSE 2      /* Connection: close */
+#define PHR_FLAG_CONNECTION_KEEP_ALIVE 4 /* Connection: keep-alive */
+/* the connection can be reused after this response: HTTP/1.1 without Connection: close or HTTP/1.0 with Connection:
+ * keep-alive, and a body that is chunked, has a Content-Length or is never sent (1xx, 204, 304). A response to HEAD is not
+ * told apart. */
+#define PHR_FLAG_KEEP_ALIVE 8
+
+struct phr_known_headers {
+    const struct phr_header *headers[PHR_NUM_KNOWN_HEADERS]; /* first of each, NULL if absent */
+    ssize_t content_length;                                  /* -1 if absent */
+    int flags;                                               /* PHR_FLAG_* */
+};
+
+/* phr_parse_response that also fills in known, if not NULL, as it goes. Names are classified by length and then compared, so
+ * no extra pass over the headers is needed. A Content-Length that is not a plain decimal number, or that differs between two
+ * headers, fails the parse with -1. Folded continuation lines are not looked at. */
+int phr_parse_response_ex(const char *_buf, size_t len, int *minor_version, int *status, const char **msg, size_t *msg_len,
+                          struct phr_header *headers, size_t *num_headers, size_t last_len, struct phr_known_headers *known);
+
 /* ditto */
 int phr_parse_headers(const char *buf, size_t len, struct phr_header *headers, size_t *num_headers, size_t last_len);
 
@@ -82,6 +112,23 @@ ssize_t phr_decode_chunked(struct phr_chunked_decoder *decoder, char *buf, size_
 /* returns if the chunked decoder is in middle of chunked data */
 int phr_decode_chunked_is_in_data(struct phr_chunked_decoder *decoder);
 
+/* widths of the scanning kernels */
+#define PHR_SIMD_NONE 0
+#define PHR_SIMD_SSE42 1  /* 16 bytes */
+#define PHR_SIMD_AVX2 2   /* 32 bytes */
+#define PHR_SIMD_AVX512 3 /* 64 bytes, AVX-512BW */
+
+/* the kernel used unless another is selected: the wider ones take longer to set up than SSE4.2 needs to get through a typical
+ * header token, see test/bench_response.c */
+#define PHR_SIMD_DEFAULT PHR_SIMD_SSE42
+
+/* On x86 the kernel is picked at runtime. This selects the one at level, or PHR_SIMD_DEFAULT for -1, capped at what the CPU
+ * supports, and returns the level now in use; threads parsing meanwhile go on with either kernel. Elsewhere the kernel is fixed
+ * at compile time and its level is returned. */
+int phr_simd_select(int level);
+/* returns the widest level the CPU supports, or the one fixed at compile time */
+int phr_simd_supported(void);
+
 #ifdef __cplusplus
 }
 #endif
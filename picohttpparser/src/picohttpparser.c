@@ -26,6 +26,7 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #ifdef __SSE4_2__
 #ifdef _MSC_VER
@@ -36,6 +37,15 @@
 #endif
 #include "picohttpparser.h"
 
+/* on x86 the scanning kernel is chosen at runtime by CPUID, see phr_simd_select() */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) &&                    \
+    !defined(PHR_NO_DISPATCH)
+#define PHR_DISPATCH 1
+#include <immintrin.h>
+#else
+#define PHR_DISPATCH 0
+#endif
+
 /* $Id$ */
 
 #if __GNUC__ >= 3
@@ -70,12 +80,19 @@
     CHECK_EOF();                                                                                                                   \
     EXPECT_CHAR_NO_CHECK(ch);
 
+#define PHR_SSIZE_MAX ((ssize_t)((size_t)-1 >> 1))
+
+/* range tables are padded to 16 bytes so that they can be loaded whole */
+#define RANGES(name, lit)                                                                                                          \
+    static const char ALIGNED(16) name[16] = lit;                                                                                  \
+    const size_t name##_size = sizeof(lit) - 1
+
 #define ADVANCE_TOKEN(tok, toklen)                                                                                                 \
     do {                                                                                                                           \
         const char *tok_start = buf;                                                                                               \
-        static const char ALIGNED(16) ranges2[] = "\000\040\177\177";                                                              \
+        RANGES(ranges2, "\000\040\177\177");                                                                                       \
         int found2;                                                                                                                \
-        buf = findchar_fast(buf, buf_end, ranges2, sizeof(ranges2) - 1, &found2);                                                  \
+        buf = findchar_fast(buf, buf_end, ranges2, ranges2_size, &found2);                                                          \
         if (!found2) {                                                                                                             \
             CHECK_EOF();                                                                                                           \
         }                                                                                                                          \
@@ -104,6 +121,198 @@ static const char *token_char_map = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
                                     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
                                     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
 
+#if PHR_DISPATCH
+
+/* Each kernel returns the first char within the ranges and sets *found, or stops short of buf_end at the point up to which it has
+ * checked and leaves the rest to the caller. ranges holds up to 8 inclusive [lo, hi] pairs, as for _mm_cmpestri. */
+typedef const char *(*findchar_fn)(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found);
+
+static const char *findchar_scalar(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    (void)buf_end;
+    (void)ranges;
+    (void)ranges_size;
+    *found = 0;
+    return buf;
+}
+
+__attribute__((target("sse4.2"))) static const char *findchar_sse42(const char *buf, const char *buf_end, const char *ranges,
+                                                                    size_t ranges_size, int *found)
+{
+    *found = 0;
+    if (likely(buf_end - buf >= 16)) {
+        __m128i ranges16 = _mm_load_si128((const __m128i *)ranges);
+
+        size_t left = (buf_end - buf) & ~15;
+        do {
+            __m128i b16 = _mm_loadu_si128((const __m128i *)buf);
+            int r = _mm_cmpestri(ranges16, ranges_size, b16, 16, _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+            if (unlikely(r != 16)) {
+                buf += r;
+                *found = 1;
+                break;
+            }
+            buf += 16;
+            left -= 16;
+        } while (likely(left != 0));
+    }
+    return buf;
+}
+
+/* Header tokens are mostly short, and pcmpestri gets through them before the wide kernels would be done setting up. Checks the
+ * first FINDCHAR_PROBE bytes that way and returns 1 if the search is over. */
+#define FINDCHAR_PROBE 64
+
+__attribute__((target("sse4.2"))) static inline int findchar_probe(const char **buf, const char *buf_end, const char *ranges,
+                                                                   size_t ranges_size, int *found)
+{
+    __m128i ranges16 = _mm_load_si128((const __m128i *)ranges);
+    const char *probe_end = buf_end - *buf > FINDCHAR_PROBE ? *buf + FINDCHAR_PROBE : buf_end;
+
+    *found = 0;
+    while (probe_end - *buf >= 16) {
+        int r = _mm_cmpestri(ranges16, ranges_size, _mm_loadu_si128((const __m128i *)*buf), 16,
+                             _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+        *buf += r;
+        if (r != 16) {
+            *found = 1;
+            return 1;
+        }
+    }
+    /* less than 16 bytes left at buf_end */
+    return probe_end == buf_end;
+}
+
+/* c lies within [lo, lo + span] iff c - lo == min(c - lo, span), all unsigned */
+__attribute__((target("avx2,sse4.2"), noinline)) static const char *findchar_avx2_wide(const char *buf, const char *buf_end,
+                                                                                      const char *ranges, size_t ranges_size,
+                                                                                      int *found)
+{
+    size_t num_ranges = ranges_size / 2, i;
+
+    if (likely(buf_end - buf >= 32)) {
+        __m256i lo[8], span[8];
+        for (i = 0; i != num_ranges; ++i) {
+            lo[i] = _mm256_set1_epi8(ranges[2 * i]);
+            span[i] = _mm256_set1_epi8((char)((unsigned char)ranges[2 * i + 1] - (unsigned char)ranges[2 * i]));
+        }
+        do {
+            __m256i b32 = _mm256_loadu_si256((const __m256i *)buf), hit = _mm256_setzero_si256();
+            for (i = 0; i != num_ranges; ++i) {
+                __m256i d = _mm256_sub_epi8(b32, lo[i]);
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[i]), d));
+            }
+            unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+            if (unlikely(mask != 0)) {
+                *found = 1;
+                return buf + __builtin_ctz(mask);
+            }
+            buf += 32;
+        } while (likely(buf_end - buf >= 32));
+    }
+    /* at most one 16-byte block is left */
+    return findchar_sse42(buf, buf_end, ranges, ranges_size, found);
+}
+
+/* the wide kernels are split off so that tokens the probe settles do not pay for their stack frame */
+__attribute__((target("sse4.2"))) static const char *findchar_avx2(const char *buf, const char *buf_end, const char *ranges,
+                                                                   size_t ranges_size, int *found)
+{
+    if (findchar_probe(&buf, buf_end, ranges, ranges_size, found))
+        return buf;
+    return findchar_avx2_wide(buf, buf_end, ranges, ranges_size, found);
+}
+
+/* masked loads cover the tail, so this one always reaches buf_end */
+__attribute__((target("avx512bw"), noinline)) static const char *findchar_avx512_wide(const char *buf, const char *buf_end,
+                                                                                     const char *ranges, size_t ranges_size,
+                                                                                     int *found)
+{
+    size_t num_ranges = ranges_size / 2, i;
+    __m512i lo[8], span[8];
+
+    for (i = 0; i != num_ranges; ++i) {
+        lo[i] = _mm512_set1_epi8(ranges[2 * i]);
+        span[i] = _mm512_set1_epi8((char)((unsigned char)ranges[2 * i + 1] - (unsigned char)ranges[2 * i]));
+    }
+    do {
+        size_t left = buf_end - buf;
+        __mmask64 valid = left >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << left) - 1, hit = 0;
+        __m512i b64 = _mm512_maskz_loadu_epi8(valid, buf);
+        for (i = 0; i != num_ranges; ++i)
+            hit |= _mm512_mask_cmple_epu8_mask(valid, _mm512_sub_epi8(b64, lo[i]), span[i]);
+        if (unlikely(hit != 0)) {
+            *found = 1;
+            return buf + __builtin_ctzll(hit);
+        }
+        buf += left >= 64 ? 64 : left;
+    } while (buf != buf_end);
+    return buf;
+}
+
+__attribute__((target("sse4.2"))) static const char *findchar_avx512(const char *buf, const char *buf_end, const char *ranges,
+                                                                     size_t ranges_size, int *found)
+{
+    /* a tail of less than 16 bytes is still scanned below */
+    if ((findchar_probe(&buf, buf_end, ranges, ranges_size, found) && *found) || buf == buf_end)
+        return buf;
+    return findchar_avx512_wide(buf, buf_end, ranges, ranges_size, found);
+}
+
+static const findchar_fn findchar_kernels[] = {findchar_scalar, findchar_sse42, findchar_avx2, findchar_avx512};
+
+/* The kernel in use, loaded and stored atomically as threads may parse while it is picked. Without SSE4.2 at compile time the
+ * CPU is asked on first use. */
+#ifdef __SSE4_2__
+static findchar_fn findchar_impl = findchar_sse42;
+#else
+static const char *findchar_init(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found);
+static findchar_fn findchar_impl = findchar_init;
+#endif
+
+int phr_simd_supported(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+        return PHR_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return PHR_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return PHR_SIMD_SSE42;
+    return PHR_SIMD_NONE;
+}
+
+int phr_simd_select(int level)
+{
+    int supported = phr_simd_supported();
+    if (level < 0)
+        level = PHR_SIMD_DEFAULT;
+    if (level > supported)
+        level = supported;
+    __atomic_store_n(&findchar_impl, findchar_kernels[level], __ATOMIC_RELAXED);
+    return level;
+}
+
+#ifndef __SSE4_2__
+static const char *findchar_init(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    return findchar_kernels[phr_simd_select(-1)](buf, buf_end, ranges, ranges_size, found);
+}
+#endif
+
+static inline const char *findchar_fast(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
+{
+    findchar_fn impl = __atomic_load_n(&findchar_impl, __ATOMIC_RELAXED);
+#ifdef __SSE4_2__
+    /* called directly, the default kernel is inlined */
+    if (likely(impl == findchar_sse42))
+        return findchar_sse42(buf, buf_end, ranges, ranges_size, found);
+#endif
+    return impl(buf, buf_end, ranges, ranges_size, found);
+}
+
+#else
+
 static const char *findchar_fast(const char *buf, const char *buf_end, const char *ranges, size_t ranges_size, int *found)
 {
     *found = 0;
@@ -133,24 +342,43 @@ static const char *findchar_fast(const char *buf, const char *buf_end, const cha
     return buf;
 }
 
+int phr_simd_supported(void)
+{
+#ifdef __SSE4_2__
+    return PHR_SIMD_SSE42;
+#else
+    return PHR_SIMD_NONE;
+#endif
+}
+
+int phr_simd_select(int level)
+{
+    (void)level;
+    return phr_simd_supported();
+}
+
+#endif
+
 static const char *get_token_to_eol(const char *buf, const char *buf_end, const char **token, size_t *token_len, int *ret)
 {
     const char *token_start = buf;
 
-#ifdef __SSE4_2__
-    static const char ranges1[] = "\0\010"
-                                  /* allow HT */
-                                  "\012\037"
-                                  /* allow SP and up to but not including DEL */
-                                  "\177\177"
-        /* allow chars w. MSB set */
-        ;
+#if defined(__SSE4_2__) || PHR_DISPATCH
+    RANGES(ranges1, "\0\010"
+                    /* allow HT */
+                    "\012\037"
+                    /* allow SP and up to but not including DEL */
+                    "\177\177"
+                    /* allow chars w. MSB set */
+    );
     int found;
-    buf = findchar_fast(buf, buf_end, ranges1, sizeof(ranges1) - 1, &found);
+    buf = findchar_fast(buf, buf_end, ranges1, ranges1_size, &found);
     if (found)
         goto FOUND_CTL;
-#else
-    /* find non-printable char within the next 8 bytes, this is the hottest code; manually inlined */
+#endif
+#ifndef __SSE4_2__
+    /* find non-printable char within the next 8 bytes (of those the runtime-selected kernel left over), this is the hottest code;
+     * manually inlined */
     while (likely(buf_end - buf >= 8)) {
 #define DOIT()                                                                                                                     \
     do {                                                                                                                           \
@@ -266,8 +494,120 @@ static const char *parse_http_version(const char *buf, const char *buf_end, int
     return buf;
 }
 
+/* case-insensitive compare against lower, which is in lower case; among the chars allowed in names and values, OR-ing 0x20
+ * folds only letters onto letters */
+static int equals_lower(const char *s, const char *lower, size_t len)
+{
+    uint64_t a, b;
+    for (; len >= 8; s += 8, lower += 8, len -= 8) {
+        memcpy(&a, s, 8);
+        memcpy(&b, lower, 8);
+        if ((a | 0x2020202020202020) != b)
+            return 0;
+    }
+    for (; len != 0; ++s, ++lower, --len)
+        if ((*s | 0x20) != *lower)
+            return 0;
+    return 1;
+}
+
+/* returns the phr_known_header of a name or -1; the length leaves at most two candidates to compare */
+static int classify_name(const char *name, size_t len)
+{
+    switch (len) {
+    case 10:
+        if (equals_lower(name, "connection", 10))
+            return PHR_HEADER_CONNECTION;
+        if (equals_lower(name, "keep-alive", 10))
+            return PHR_HEADER_KEEP_ALIVE;
+        break;
+    case 12:
+        if (equals_lower(name, "content-type", 12))
+            return PHR_HEADER_CONTENT_TYPE;
+        break;
+    case 14:
+        if (equals_lower(name, "content-length", 14))
+            return PHR_HEADER_CONTENT_LENGTH;
+        break;
+    case 17:
+        if (equals_lower(name, "transfer-encoding", 17))
+            return PHR_HEADER_TRANSFER_ENCODING;
+        break;
+    }
+    return -1;
+}
+
+/* returns the next element of a comma-separated list without whitespace and parameters, or NULL at the end */
+static const char *next_list_token(const char **p, const char *p_end, size_t *token_len)
+{
+    const char *token;
+
+    while (*p != p_end && (**p == ',' || **p == ' ' || **p == '\t'))
+        ++*p;
+    if (*p == p_end)
+        return NULL;
+    token = *p;
+    while (*p != p_end && **p != ',' && **p != ';' && **p != ' ' && **p != '\t')
+        ++*p;
+    *token_len = *p - token;
+    while (*p != p_end && **p != ',')
+        ++*p;
+    return token;
+}
+
+/* returns -1 if the header makes the message unparsable */
+static int classify_header(const struct phr_header *header, struct phr_known_headers *known)
+{
+    int id = classify_name(header->name, header->name_len);
+    const char *p = header->value, *p_end = p + header->value_len, *token;
+    size_t token_len;
+
+    if (id < 0)
+        return 0;
+
+    switch (id) {
+    case PHR_HEADER_CONTENT_LENGTH: {
+        ssize_t value = 0;
+        /* the value may carry trailing whitespace */
+        while (p != p_end && (p_end[-1] == ' ' || p_end[-1] == '\t'))
+            --p_end;
+        if (p == p_end)
+            return -1;
+        for (; p != p_end; ++p) {
+            if (*p < '0' || '9' < *p || value > (PHR_SSIZE_MAX - 9) / 10)
+                return -1;
+            value = value * 10 + *p - '0';
+        }
+        if (known->content_length >= 0 && known->content_length != value)
+            return -1;
+        known->content_length = value;
+    } break;
+    case PHR_HEADER_CONNECTION:
+        while ((token = next_list_token(&p, p_end, &token_len)) != NULL) {
+            if (token_len == 5 && equals_lower(token, "close", 5))
+                known->flags |= PHR_FLAG_CONNECTION_CLOSE;
+            else if (token_len == 10 && equals_lower(token, "keep-alive", 10))
+                known->flags |= PHR_FLAG_CONNECTION_KEEP_ALIVE;
+        }
+        break;
+    case PHR_HEADER_TRANSFER_ENCODING:
+        /* codings apply in order, also across headers; chunked only frames the body if it comes last */
+        while ((token = next_list_token(&p, p_end, &token_len)) != NULL) {
+            if (token_len == 7 && equals_lower(token, "chunked", 7))
+                known->flags |= PHR_FLAG_CHUNKED;
+            else
+                known->flags &= ~PHR_FLAG_CHUNKED;
+        }
+        break;
+    }
+
+    if (known->headers[id] == NULL)
+        known->headers[id] = header;
+    return 0;
+}
+
 static const char *parse_headers(const char *buf, const char *buf_end, struct phr_header *headers, size_t *num_headers,
-                                 size_t max_headers, int *ret)
+                                 size_t max_headers, struct phr_known_headers *known, int *ret)
 {
     for (;; ++*num_headers) {
         CHECK_EOF();
@@ -287,16 +627,16 @@ static const char *parse_headers(const char *buf, const char *buf_end, struct ph
             /* parsing name, but do not discard SP before colon, see
              * http://www.mozilla.org/security/announce/2006/mfsa2006-33.html */
             headers[*num_headers].name = buf;
-            static const char ALIGNED(16) ranges1[] = "\x00 "  /* control chars and up to SP */
-                                                      "\"\""   /* 0x22 */
-                                                      "()"     /* 0x28,0x29 */
-                                                      ",,"     /* 0x2c */
-                                                      "//"     /* 0x2f */
-                                                      ":@"     /* 0x3a-0x40 */
-                                                      "[]"     /* 0x5b-0x5d */
-                                                      "{\377"; /* 0x7b-0xff */
+            RANGES(ranges1, "\x00 "  /* control chars and up to SP */
+                            "\"\""   /* 0x22 */
+                            "()"     /* 0x28,0x29 */
+                            ",,"     /* 0x2c */
+                            "//"     /* 0x2f */
+                            ":@"     /* 0x3a-0x40 */
+                            "[]"     /* 0x5b-0x5d */
+                            "{\377"); /* 0x7b-0xff */
             int found;
-            buf = findchar_fast(buf, buf_end, ranges1, sizeof(ranges1) - 1, &found);
+            buf = findchar_fast(buf, buf_end, ranges1, ranges1_size, &found);
             if (!found) {
                 CHECK_EOF();
             }
@@ -328,6 +668,10 @@ static const char *parse_headers(const char *buf, const char *buf_end, struct ph
         if ((buf = get_token_to_eol(buf, buf_end, &headers[*num_headers].value, &headers[*num_headers].value_len, ret)) == NULL) {
             return NULL;
         }
+        if (known != NULL && headers[*num_headers].name != NULL && classify_header(headers + *num_headers, known) != 0) {
+            *ret = -1;
+            return NULL;
+        }
     }
     return buf;
 }
@@ -363,7 +707,7 @@ static const char *parse_request(const char *buf, const char *buf_end, const cha
         return NULL;
     }
 
-    return parse_headers(buf, buf_end, headers, num_headers, max_headers, ret);
+    return parse_headers(buf, buf_end, headers, num_headers, max_headers, NULL, ret);
 }
 
 int phr_parse_request(const char *buf_start, size_t len, const char **method, size_t *method_len, const char **path,
@@ -395,7 +739,8 @@ int phr_parse_request(const char *buf_start, size_t len, const char **method, si
 }
 
 static const char *parse_response(const char *buf, const char *buf_end, int *minor_version, int *status, const char **msg,
-                                  size_t *msg_len, struct phr_header *headers, size_t *num_headers, size_t max_headers, int *ret)
+                                  size_t *msg_len, struct phr_header *headers, size_t *num_headers, size_t max_headers,
+                                  struct phr_known_headers *known, int *ret)
 {
     /* parse "HTTP/1.x" */
     if ((buf = parse_http_version(buf, buf_end, minor_version, ret)) == NULL) {
@@ -423,11 +768,17 @@ static const char *parse_response(const char *buf, const char *buf_end, int *min
         return NULL;
     }
 
-    return parse_headers(buf, buf_end, headers, num_headers, max_headers, ret);
+    return parse_headers(buf, buf_end, headers, num_headers, max_headers, known, ret);
 }
 
 int phr_parse_response(const char *buf_start, size_t len, int *minor_version, int *status, const char **msg, size_t *msg_len,
                        struct phr_header *headers, size_t *num_headers, size_t last_len)
+{
+    return phr_parse_response_ex(buf_start, len, minor_version, status, msg, msg_len, headers, num_headers, last_len, NULL);
+}
+
+int phr_parse_response_ex(const char *buf_start, size_t len, int *minor_version, int *status, const char **msg, size_t *msg_len,
+                          struct phr_header *headers, size_t *num_headers, size_t last_len, struct phr_known_headers *known)
 {
     const char *buf = buf_start, *buf_end = buf + len;
     size_t max_headers = *num_headers;
@@ -438,6 +789,11 @@ int phr_parse_response(const char *buf_start, size_t len, int *minor_version, in
     *msg = NULL;
     *msg_len = 0;
     *num_headers = 0;
+    if (known != NULL) {
+        memset(known->headers, 0, sizeof(known->headers));
+        known->content_length = -1;
+        known->flags = 0;
+    }
 
     /* if last_len != 0, check if the response is complete (a fast countermeasure
        against slowloris */
@@ -445,10 +801,21 @@ int phr_parse_response(const char *buf_start, size_t len, int *minor_version, in
         return r;
     }
 
-    if ((buf = parse_response(buf, buf_end, minor_version, status, msg, msg_len, headers, num_headers, max_headers, &r)) == NULL) {
+    if ((buf = parse_response(buf, buf_end, minor_version, status, msg, msg_len, headers, num_headers, max_headers, known, &r)) ==
+        NULL) {
         return r;
     }
 
+    if (known != NULL) {
+        int persistent = *minor_version >= 1 ? !(known->flags & PHR_FLAG_CONNECTION_CLOSE)
+                                             : (known->flags & (PHR_FLAG_CONNECTION_CLOSE | PHR_FLAG_CONNECTION_KEEP_ALIVE)) ==
+                                                   PHR_FLAG_CONNECTION_KEEP_ALIVE;
+        int framed = (known->flags & PHR_FLAG_CHUNKED) || known->content_length >= 0 || *status / 100 == 1 || *status == 204 ||
+                     *status == 304;
+        if (persistent && framed)
+            known->flags |= PHR_FLAG_KEEP_ALIVE;
+    }
+
     return (int)(buf - buf_start);
 }
 
@@ -466,7 +833,7 @@ int phr_parse_headers(const char *buf_start, size_t len, struct phr_header *head
         return r;
     }
 
-    if ((buf = parse_headers(buf, buf_end, headers, num_headers, max_headers, &r)) == NULL) {
+    if ((buf = parse_headers(buf, buf_end, headers, num_headers, max_headers, NULL, &r)) == NULL) {
         return r;
     }
 
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2009-2014 Kazuho Oku, Tokuhiro Matsuno, Daisuke Murase,
+ *                         Shigeo Mitsunari
+ *
+ * The software is licensed under either the MIT License (below) or the Perl
+ * license.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Times phr_parse_response and phr_decode_chunked on the responses of a Nano node, once per scanning kernel the CPU supports.
+ *
+ *   make bench-response && ./bench-response [seconds per case, 0.2 by default]
+ *
+ * ns/byte is per byte of input: the headers for the parse cases, the encoded body for the chunked ones. cyc/hdr is in TSC
+ * ticks, which run at the nominal clock rate. Build with -DPHR_NO_DISPATCH to time the compile-time kernel instead. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "picohttpparser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+/* straight from the node */
+#define BLOCK_COUNT_RESPONSE                                                                                                       \
+    "HTTP/1.1 200 OK\r\n"                                                                                                          \
+    "Content-Type: application/json\r\n"                                                                                           \
+    "Access-Control-Allow-Origin: *\r\n"                                                                                           \
+    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"                                                                              \
+    "Access-Control-Allow-Headers: Accept, Accept-Language, Content-Language, Content-Type\r\n"                                    \
+    "Connection: keep-alive\r\n"                                                                                                   \
+    "Content-Length: 59\r\n"                                                                                                       \
+    "\r\n"                                                                                                                         \
+    "{\"count\":\"112582312\",\"unchecked\":\"12\",\"cemented\":\"112582300\"}"
+
+/* through a reverse proxy, which streams it chunked */
+#define ACCOUNT_HISTORY_HEADERS                                                                                                    \
+    "HTTP/1.1 200 OK\r\n"                                                                                                          \
+    "Server: nginx/1.18.0 (Ubuntu)\r\n"                                                                                            \
+    "Date: Sat, 17 Oct 2026 09:12:44 GMT\r\n"                                                                                      \
+    "Content-Type: application/json\r\n"                                                                                           \
+    "Transfer-Encoding: chunked\r\n"                                                                                               \
+    "Connection: keep-alive\r\n"                                                                                                   \
+    "Vary: Accept-Encoding\r\n"                                                                                                    \
+    "Access-Control-Allow-Origin: *\r\n"                                                                                           \
+    "Access-Control-Allow-Methods: POST, OPTIONS\r\n"                                                                              \
+    "Access-Control-Allow-Headers: Accept, Accept-Language, Content-Language, Content-Type\r\n"                                    \
+    "Strict-Transport-Security: max-age=63072000\r\n"                                                                              \
+    "X-Content-Type-Options: nosniff\r\n"                                                                                          \
+    "\r\n"
+
+#define ACCOUNT "nano_1jo1tywi9tnk9oqqw6qiqrt4p9e5x4cukowx4zp6wd4f7w8pgbf9kcrrzj1h"
+#define HISTORY_ENTRIES 24
+
+static const char *level_names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+static double min_seconds = 0.2;
+static volatile size_t sink;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long ticks(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct result {
+    double ns;
+    double cycles;
+};
+
+/* runs fn in batches until min_seconds have passed, returning the time of one call */
+static struct result measure(void (*fn)(void *), void *arg)
+{
+    struct result r;
+    unsigned long long iterations = 0, batch = 1, t0;
+    double start, elapsed;
+
+    fn(arg); /* warm up */
+    start = now();
+    t0 = ticks();
+    do {
+        unsigned long long i;
+        for (i = 0; i != batch; ++i)
+            fn(arg);
+        iterations += batch;
+        batch *= 2;
+        elapsed = now() - start;
+    } while (elapsed < min_seconds);
+    r.cycles = (double)(ticks() - t0) / iterations;
+    r.ns = elapsed * 1e9 / iterations;
+    return r;
+}
+
+struct parse_case {
+    const char *buf;
+    size_t len;
+    size_t step; /* 0 for all at once, otherwise replay arriving this many bytes at a time */
+    size_t num_headers;
+    int known; /* through phr_parse_response_ex */
+};
+
+static void parse_once(void *arg)
+{
+    struct parse_case *c = arg;
+    struct phr_header headers[32];
+    struct phr_known_headers known;
+    const char *msg;
+    size_t msg_len, num_headers, len = c->step ? 0 : c->len, last_len = 0;
+    int minor_version, status, ret;
+
+    do {
+        if (c->step) {
+            last_len = len;
+            len = len + c->step < c->len ? len + c->step : c->len;
+        }
+        num_headers = sizeof(headers) / sizeof(headers[0]);
+        ret = phr_parse_response_ex(c->buf, len, &minor_version, &status, &msg, &msg_len, headers, &num_headers, last_len,
+                                    c->known ? &known : NULL);
+    } while (ret == -2 && len != c->len);
+    sink += ret + num_headers;
+}
+
+struct chunked_case {
+    const char *encoded;
+    size_t len;
+    size_t step; /* segments the body arrives in, 0 for all at once */
+    char *work;
+    size_t decoded_len;
+};
+
+static void copy_once(void *arg)
+{
+    struct chunked_case *c = arg;
+    memcpy(c->work, c->encoded, c->len);
+    sink += c->work[c->len - 1];
+}
+
+/* the decoder works in place, so each round starts from a fresh copy; copy_once is timed to take that out again */
+static void decode_once(void *arg)
+{
+    struct chunked_case *c = arg;
+    struct phr_chunked_decoder decoder = {0};
+    size_t off = 0, decoded = 0;
+    ssize_t ret;
+
+    decoder.consume_trailer = 1;
+    memcpy(c->work, c->encoded, c->len);
+    do {
+        size_t size = c->step && c->step < c->len - off ? c->step : c->len - off;
+        ret = phr_decode_chunked(&decoder, c->work + off, &size);
+        off += c->step ? c->step : c->len;
+        decoded += size;
+    } while (ret == -2 && off < c->len);
+    assert(ret == 0);
+    sink += decoded;
+}
+
+static void report(const char *name, const char *level, size_t bytes, size_t num_headers, struct result r)
+{
+    printf("%-28s %-7s %7zu %10.1f %8.3f", name, level, bytes, r.ns, r.ns / bytes);
+    if (HAVE_TSC && num_headers != 0)
+        printf(" %8.1f\n", r.cycles / num_headers);
+    else
+        printf(" %8s\n", "-");
+}
+
+static void bench_parse(const char *name, const char *level, const char *buf, size_t step, int known)
+{
+    struct phr_header headers[32];
+    const char *msg;
+    size_t msg_len, num_headers = sizeof(headers) / sizeof(headers[0]);
+    int minor_version, status, ret;
+    struct parse_case c = {buf, strlen(buf), step, 0, known};
+
+    ret = phr_parse_response(c.buf, c.len, &minor_version, &status, &msg, &msg_len, headers, &num_headers, 0);
+    assert(ret > 0);
+    c.len = ret;
+    c.num_headers = num_headers;
+    report(name, level, c.len, c.num_headers, measure(parse_once, &c));
+}
+
+static void bench_chunked(const char *name, const char *level, const char *body, size_t chunk_size, size_t step)
+{
+    size_t body_len = strlen(body), off, len = 0, decoded_len;
+    char *encoded = malloc(body_len * 2 + 64);
+    struct chunked_case c;
+    struct result copy, r;
+    ssize_t ret;
+
+    for (off = 0; off < body_len; off += chunk_size) {
+        size_t n = body_len - off < chunk_size ? body_len - off : chunk_size;
+        len += sprintf(encoded + len, "%zx\r\n", n);
+        memcpy(encoded + len, body + off, n);
+        len += n;
+        len += sprintf(encoded + len, "\r\n");
+    }
+    len += sprintf(encoded + len, "0\r\n\r\n");
+
+    c.encoded = encoded;
+    c.len = len;
+    c.step = step;
+    c.work = malloc(len);
+    decoded_len = len;
+    memcpy(c.work, encoded, len);
+    {
+        struct phr_chunked_decoder decoder = {0};
+        decoder.consume_trailer = 1;
+        ret = phr_decode_chunked(&decoder, c.work, &decoded_len);
+        if (ret != 0 || decoded_len != body_len || memcmp(c.work, body, body_len) != 0) {
+            fprintf(stderr, "%s: decoded body differs\n", name);
+            exit(1);
+        }
+    }
+
+    copy = measure(copy_once, &c);
+    r = measure(decode_once, &c);
+    r.ns -= copy.ns;
+    r.cycles -= copy.cycles;
+    report(name, level, len, 0, r);
+
+    free(c.work);
+    free(encoded);
+}
+
+static char *account_history_body(void)
+{
+    size_t len = 0, i;
+    char *body = malloc(HISTORY_ENTRIES * 512 + 256);
+
+    len += sprintf(body + len, "{\"account\":\"" ACCOUNT "\",\"history\":[");
+    for (i = 0; i != HISTORY_ENTRIES; ++i) {
+        len += sprintf(body + len,
+                       "%s{\"type\":\"%s\",\"account\":\"" ACCOUNT "\",\"amount\":\"%zu000000000000000000000000000\","
+                       "\"local_timestamp\":\"%zu\",\"height\":\"%zu\",\"hash\":\"%016llX%016llX%016llX%016llX\",\"confirmed\":\"true\"}",
+                       i ? "," : "", i % 3 ? "receive" : "send", i + 1, 1790000000 - i * 3600, 4096 - i, i * 0x9E3779B97F4A7C15ULL, ~i * 0xC2B2AE3D27D4EB4FULL,
+                       i * 0x165667B19E3779F9ULL, ~i * 0x27D4EB2F165667C5ULL);
+    }
+    len += sprintf(body + len, "],\"previous\":\"%064X\"}", 0xC0FFEE);
+    return body;
+}
+
+int main(int argc, char **argv)
+{
+    char *history = account_history_body(), *proxied = malloc(sizeof(ACCOUNT_HISTORY_HEADERS));
+    int best, level;
+
+    if (argc > 1)
+        min_seconds = atof(argv[1]);
+    strcpy(proxied, ACCOUNT_HISTORY_HEADERS);
+
+    printf("%-28s %-7s %7s %10s %8s %8s\n", "case", "kernel", "bytes", "ns/op", "ns/byte", "cyc/hdr");
+    best = phr_simd_supported();
+    for (level = PHR_SIMD_NONE; level <= best; ++level) {
+        const char *name = level_names[level];
+        /* fixed at compile time */
+        if (phr_simd_select(level) != level)
+            continue;
+        bench_parse("block_count", name, BLOCK_COUNT_RESPONSE, 0, 0);
+        bench_parse("block_count, 1 byte/read", name, BLOCK_COUNT_RESPONSE, 1, 0);
+        bench_parse("account_history", name, proxied, 0, 0);
+        bench_parse("account_history, known hdrs", name, proxied, 0, 1);
+        bench_parse("account_history, 64 B/read", name, proxied, 64, 0);
+        bench_chunked("chunked, 1 KB chunks", name, history, 1024, 0);
+        bench_chunked("chunked, 16 B chunks", name, history, 16, 0);
+        bench_chunked("chunked, 16 B, 100 B/read", name, history, 16, 100);
+    }
+    phr_simd_select(-1);
+
+    free(proxied);
+    free(history);
+    return 0;
+}
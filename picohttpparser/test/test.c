@@ -233,6 +233,87 @@ static void test_response(void)
 #undef PARSE
 }
 
+static void test_response_known(void)
+{
+    int minor_version;
+    int status;
+    const char *msg;
+    size_t msg_len;
+    struct phr_header headers[8];
+    size_t num_headers;
+    struct phr_known_headers known;
+
+#define PARSE(s, exp, comment)                                                                                                     \
+    do {                                                                                                                           \
+        note(comment);                                                                                                             \
+        num_headers = sizeof(headers) / sizeof(headers[0]);                                                                        \
+        ok(phr_parse_response_ex(s, strlen(s), &minor_version, &status, &msg, &msg_len, headers, &num_headers, 0, &known) ==       \
+           (exp == 0 ? strlen(s) : exp));                                                                                          \
+    } while (0)
+
+    PARSE("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 59\r\n\r\n", 0, "content-length");
+    ok(known.content_length == 59);
+    ok(known.flags == PHR_FLAG_KEEP_ALIVE);
+    ok(known.headers[PHR_HEADER_CONTENT_TYPE] == &headers[0]);
+    ok(known.headers[PHR_HEADER_CONTENT_LENGTH] == &headers[1]);
+    ok(known.headers[PHR_HEADER_CONNECTION] == NULL);
+    ok(known.headers[PHR_HEADER_TRANSFER_ENCODING] == NULL);
+
+    PARSE("HTTP/1.1 200 OK\r\ncONTENT-lENGTH: 0\r\nconnection: Upgrade, CLOSE\r\n\r\n", 0, "mixed case");
+    ok(known.content_length == 0);
+    ok(known.flags == PHR_FLAG_CONNECTION_CLOSE);
+    ok(known.headers[PHR_HEADER_CONNECTION] == &headers[1]);
+
+    PARSE("HTTP/1.1 200 OK\r\nContent-Lengths: 5\r\nConnectionx: close\r\nX-Content-Length: 5\r\n\r\n", 0, "similar names");
+    ok(known.content_length == -1);
+    ok(known.flags == 0);
+    ok(known.headers[PHR_HEADER_CONTENT_LENGTH] == NULL);
+
+    PARSE("HTTP/1.0 200 OK\r\nContent-Length: 5\r\n\r\n", 0, "HTTP/1.0");
+    ok(known.flags == 0);
+    PARSE("HTTP/1.0 200 OK\r\nContent-Length: 5\r\nConnection: Keep-Alive\r\nKeep-Alive: timeout=5\r\n\r\n", 0,
+          "HTTP/1.0 keep-alive");
+    ok(known.flags == (PHR_FLAG_CONNECTION_KEEP_ALIVE | PHR_FLAG_KEEP_ALIVE));
+    ok(known.headers[PHR_HEADER_KEEP_ALIVE] == &headers[2]);
+
+    PARSE("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n", 0, "chunked");
+    ok(known.content_length == -1);
+    ok(known.flags == (PHR_FLAG_CHUNKED | PHR_FLAG_KEEP_ALIVE));
+    PARSE("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: gzip\r\n\r\n", 0, "chunked not last");
+    ok(known.flags == 0);
+    PARSE("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked ; x=1 ,\r\nContent-Length: 10\r\n\r\n", 0, "chunked with length");
+    ok(known.content_length == 10);
+    ok(known.flags == (PHR_FLAG_CHUNKED | PHR_FLAG_KEEP_ALIVE));
+
+    PARSE("HTTP/1.1 200 OK\r\nServer: x\r\n\r\n", 0, "delimited by close");
+    ok(known.flags == 0);
+    PARSE("HTTP/1.1 204 No Content\r\n\r\n", 0, "no body");
+    ok(known.flags == PHR_FLAG_KEEP_ALIVE);
+
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 7\r\ncontent-length: 7\r\n\r\n", 0, "repeated content-length");
+    ok(known.content_length == 7);
+    ok(known.headers[PHR_HEADER_CONTENT_LENGTH] == &headers[0]);
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 7\r\nContent-Length: 8\r\n\r\n", -1, "conflicting content-length");
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 13 \r\n\r\n", 0, "content-length trailing space");
+    ok(known.content_length == 13);
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 13\t\r\n\r\n", 0, "content-length trailing tab");
+    ok(known.content_length == 13);
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: \t \r\n\r\n", -1, "blank content-length");
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: \r\n\r\n", -1, "empty content-length");
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n", -1, "negative content-length");
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 5 5\r\n\r\n", -1, "content-length list");
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 99999999999999999999999\r\n\r\n", -1, "content-length overflow");
+
+    PARSE("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n", -2, "partial");
+
+    note("without known");
+    num_headers = sizeof(headers) / sizeof(headers[0]);
+    ok(phr_parse_response_ex("HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n", 38, &minor_version, &status, &msg, &msg_len, headers,
+                             &num_headers, 0, NULL) == 38);
+
+#undef PARSE
+}
+
 static void test_headers(void)
 {
     /* only test the interface; the core parser is tested by the tests above */
@@ -408,11 +489,96 @@ static void test_chunked_consume_trailer(void)
     }
 }
 
+/* parses one request with the kernel at level, returning a digest of the outcome */
+static int parse_at_level(int level, const char *buf, size_t len, char *out, size_t out_len)
+{
+    const char *method, *path;
+    size_t method_len, path_len, num_headers = 4, i;
+    int minor_version, ret, n;
+    struct phr_header headers[4];
+
+    phr_simd_select(level);
+    ret = phr_parse_request(buf, len, &method, &method_len, &path, &path_len, &minor_version, headers, &num_headers, 0);
+    n = snprintf(out, out_len, "%d %zu %zu", ret, method_len, path_len);
+    if (ret > 0) {
+        for (i = 0; i != num_headers; ++i)
+            n += snprintf(out + n, out_len - n, " %zu:%zu", headers[i].name_len, headers[i].value_len);
+    }
+    return ret;
+}
+
+/* the kernels differ in block width and in how they handle the tail, so move one odd byte across every offset of tokens that
+ * straddle 16, 32 and 64 byte boundaries and expect the same outcome from each */
+static void test_simd_kernels(void)
+{
+    static const char odd[] = {'\001', '\t', '\177', '\200', '\377', ' ', ':'};
+    int best = phr_simd_supported(), level, mismatches = 0;
+    size_t path_len, value_len, pos, i;
+    char buf[512], expected[256], actual[256];
+
+    for (path_len = 1; path_len <= 130; path_len += 3) {
+        for (value_len = 0; value_len <= 130; value_len += 5) {
+            size_t len = 0, path_at, value_at;
+            len += sprintf(buf + len, "GET /");
+            path_at = len;
+            memset(buf + len, 'p', path_len);
+            len += path_len;
+            len += sprintf(buf + len, " HTTP/1.1\r\nHost: example.com\r\nX-Value: ");
+            value_at = len;
+            memset(buf + len, 'v', value_len);
+            len += value_len;
+            len += sprintf(buf + len, "\r\n\r\n");
+            for (i = 0; i != sizeof(odd); ++i) {
+                for (pos = 0; pos < path_len + value_len; ++pos) {
+                    char *at = pos < path_len ? buf + path_at + pos : buf + value_at + pos - path_len, saved = *at;
+                    size_t cut;
+                    *at = odd[i];
+                    /* complete, and cut short in the middle of the odd token */
+                    for (cut = 0; cut != 2; ++cut) {
+                        size_t l = cut ? (size_t)(at - buf) + 1 : len;
+                        parse_at_level(PHR_SIMD_NONE, buf, l, expected, sizeof(expected));
+                        for (level = PHR_SIMD_NONE + 1; level <= best; ++level) {
+                            parse_at_level(level, buf, l, actual, sizeof(actual));
+                            if (strcmp(expected, actual) != 0 && mismatches++ < 5)
+                                note("level %d, path %zu, value %zu, byte %zu = %02x: %s != %s", level, path_len, value_len, pos,
+                                     (unsigned char)odd[i], actual, expected);
+                        }
+                    }
+                    *at = saved;
+                }
+            }
+        }
+    }
+    ok(mismatches == 0);
+    phr_simd_select(-1);
+}
+
+static void test_simd(void)
+{
+    static void (*const tests[])(void) = {test_request, test_response, test_headers};
+    static const char *const names[] = {"request", "response", "headers"};
+    int best = phr_simd_supported(), current = phr_simd_select(-1), level;
+    size_t i;
+
+    /* the default level is in use when the other subtests run; the others are covered here */
+    for (level = PHR_SIMD_NONE; level <= best; ++level) {
+        if (level == current)
+            continue;
+        phr_simd_select(level);
+        for (i = 0; i != sizeof(tests) / sizeof(tests[0]); ++i)
+            subtest(names[i], tests[i]);
+    }
+    phr_simd_select(-1);
+    subtest("kernels", test_simd_kernels);
+}
+
 int main(int argc, char **argv)
 {
     subtest("request", test_request);
     subtest("response", test_response);
+    subtest("response-known", test_response_known);
     subtest("headers", test_headers);
+    subtest("simd", test_simd);
     subtest("chunked", test_chunked);
     subtest("chunked-consume-trailer", test_chunked_consume_trailer);
     return done_testing();
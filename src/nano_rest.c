@@ -3,12 +3,19 @@
  https://www.joltwallet.com/
  */
 
+#include "sdkconfig.h"
+// Compiles out log calls above the configured level
+#define LOG_LOCAL_LEVEL CONFIG_NANO_REST_LOG_LEVEL
+
 #include <stdio.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 #include "esp_event_loop.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 #include "esp_log.h"
 
@@ -20,260 +27,2447 @@
 
 #include "picohttpparser.h"
 #include "nano_rest.h"
+#include "nano_rest_stats.h"
+#include "nano_rest_cache.h"
+#include "nano_rest_json.h"
+#include "nano_rest_rpc.h"
+#include "esp_timer.h"
 
 char rx_string[RX_BUFFER_BYTES];
 
 static const char *TAG = "network_rest";
 
 // Can be set via the setter functions
-static char *remote_domain = NULL;
-static uint16_t remote_port = 0;
-static char *remote_path = NULL;
-static SemaphoreHandle_t http_request_complete = NULL; // Underlying type: (void *)
+
+// Requests are executed by a long-lived task running an event loop
+static QueueHandle_t http_request_queue = NULL;
+static SemaphoreHandle_t http_job_lock = NULL; // guards task_args_t socket/cancel state
+static SemaphoreHandle_t http_state_lock = NULL; // guards endpoints, conn pool and DNS cache
+static int http_ctrl_fd = -1; // wakes the event loop, see http_ctrl_open
+static volatile int http_wake_fd = -1;
+static struct sockaddr_in http_ctrl_addr;
+#define HTTP_POLL_INTERVAL_MS 10 // new job latency without a control socket
+static portMUX_TYPE http_init_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint8_t http_init_state = 0; // 0: not started, 1: starting, 2: running
+
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+#if CONFIG_NANO_REST_KEEP_ALIVE
+#define HTTP_VERSION_STR "HTTP/1.1"
+#define CONNECTION_STR "keep-alive"
+#define HTTP_PIPELINE_DEPTH CONFIG_NANO_REST_PIPELINE_DEPTH
+#else
+#define HTTP_VERSION_STR "HTTP/1.0"
+#define CONNECTION_STR "close"
+#define HTTP_PIPELINE_DEPTH 1 // HTTP/1.0 allows one request per connection
+#endif
 
 static const char GET_FORMAT_STR[] = \
-        "GET %s HTTP/1.0\r\n"
+        "GET %s " HTTP_VERSION_STR "\r\n"
         "Host: %s\r\n"
         "User-Agent: esp-idf/1.0 esp32\r\n"
+        "Connection: " CONNECTION_STR "\r\n"
         "\r\n";
 
-static const char POST_FORMAT_STR[] = \
-        "POST %s HTTP/1.0\r\n"
+/* Everything up to the Content-Length value is the same for every POST;
+ * it is rendered once per endpoint change into its post_prefix. */
+static const char POST_PREFIX_FORMAT_STR[] = \
+        "POST %s " HTTP_VERSION_STR "\r\n"
          "Host: %s\r\n" \
          "User-Agent: esp-idf/1.0 esp32\r\n"
+         "Connection: " CONNECTION_STR "\r\n"
          "Content-Type: text/plain\r\n"
-         "Content-Length: %d\r\n"
-         "\r\n"
-         "%s";
+         "Content-Length: ";
+static const char POST_LENGTH_FORMAT_STR[] = "%u\r\n\r\n";
+#define POST_LENGTH_BUF_SIZE 16
+#define HTTP_RPC_KEY_SIZE 192 // typed RPC bodies looked up in the cache
 
+/* A queued request. Shared between the caller and the event loop and freed by
+ * whichever drops the last reference, so a caller that gives up on a slow
+ * request can return immediately. Asynchronous requests have a callback
+ * instead of a result buffer and are only referenced by the event loop. */
 typedef struct task_args_t {
     int get_post;
-    char *post_data;
+    char *post_data; // owned copy
+    size_t post_len; // of the last request body, e.g. the only one
+    bool idempotent; // safe to send again, e.g. to another node
+    bool writes; // publishes a block, see cache_invalidate
+    const cache_policy_t *cache; // NULL if the response is not cached
+    uint32_t cache_gen;
     char *result_data_buf;
     size_t result_data_buf_len;
+    nano_rest_cb_t cb;
+    void *cb_ctx;
+    nano_rest_chunk_cb_t on_chunk; // streaming mode if set
+    void *chunk_ctx;
+    nano_rest_batch_item_t *batch; // pipelined batch mode if set
+    size_t batch_len;
+    int result;
+    nano_rest_handle_t id;
+    // Below protected by http_job_lock
+    int s; // socket in use by the event loop, -1 if none
+    bool cancelled;
+    uint8_t refs;
+    SemaphoreHandle_t complete; // NULL for asynchronous requests
+    struct task_args_t *next;
 } task_args_t;
 
-void nano_rest_set_remote_domain(char *str){
-    if( NULL != remote_domain ){
-        free(remote_domain);
+// Live requests, so handles can be resolved without dangling pointers
+static task_args_t *http_jobs = NULL;
+static nano_rest_handle_t http_job_next_id = 1;
+
+#if CONFIG_NANO_REST_DNS_CACHE_TTL > 0
+/* Resolved address cache so the DNS round trip is only paid once per TTL. */
+#define DNS_CACHE_SIZE 4
+
+typedef struct dns_cache_entry_t {
+    char *domain;
+    uint16_t port;
+    struct sockaddr_in addr;
+    TickType_t expires;
+} dns_cache_entry_t;
+
+static dns_cache_entry_t dns_cache[DNS_CACHE_SIZE];
+
+static void dns_cache_entry_clear(dns_cache_entry_t *e) {
+    if( NULL != e->domain ) {
+        free(e->domain);
     }
-    if( NULL != str ){
-        remote_domain = malloc(strlen(str)+1);
-        strcpy(remote_domain, str);
+    e->domain = NULL;
+    e->port = 0;
+}
+
+static void dns_cache_flush(void) {
+    for( int i = 0; i < DNS_CACHE_SIZE; i++ ) {
+        dns_cache_entry_clear(&dns_cache[i]);
     }
-    else{
-        remote_domain = NULL;
+}
+
+static dns_cache_entry_t *dns_cache_find(const char *domain, uint16_t port) {
+    for( int i = 0; i < DNS_CACHE_SIZE; i++ ) {
+        dns_cache_entry_t *e = &dns_cache[i];
+        if( NULL != e->domain && port == e->port &&
+                0 == strcmp(domain, e->domain) ) {
+            return e;
+        }
     }
+    return NULL;
 }
 
-void nano_rest_set_remote_port(uint16_t port){
-    remote_port = port;
+static bool dns_cache_lookup(const char *domain, uint16_t port,
+        struct sockaddr_in *addr) {
+    dns_cache_entry_t *e = dns_cache_find(domain, port);
+    if( NULL == e ) {
+        return false;
+    }
+    if( (int32_t)(xTaskGetTickCount() - e->expires) >= 0 ) {
+        dns_cache_entry_clear(e);
+        return false;
+    }
+    *addr = e->addr;
+    return true;
 }
 
-void nano_rest_set_remote_path(char *str){
-    if( NULL != remote_path ){
-        free(remote_path);
+static void dns_cache_store(const char *domain, uint16_t port,
+        const struct sockaddr_in *addr) {
+    dns_cache_entry_t *e = dns_cache_find(domain, port);
+    if( NULL == e ) {
+        // Take a free entry, otherwise the one closest to expiring
+        e = &dns_cache[0];
+        for( int i = 0; i < DNS_CACHE_SIZE; i++ ) {
+            if( NULL == dns_cache[i].domain ) {
+                e = &dns_cache[i];
+                break;
+            }
+            if( (int32_t)(dns_cache[i].expires - e->expires) < 0 ) {
+                e = &dns_cache[i];
+            }
+        }
+        dns_cache_entry_clear(e);
+        e->domain = malloc(strlen(domain)+1);
+        if( NULL == e->domain ) {
+            return;
+        }
+        strcpy(e->domain, domain);
+        e->port = port;
+    }
+    e->addr = *addr;
+    e->expires = xTaskGetTickCount() +
+            pdMS_TO_TICKS(CONFIG_NANO_REST_DNS_CACHE_TTL * 1000);
+}
+
+static void dns_cache_invalidate(const char *domain, uint16_t port) {
+    dns_cache_entry_t *e = dns_cache_find(domain, port);
+    if( NULL != e ) {
+        dns_cache_entry_clear(e);
+    }
+}
+#else
+#define dns_cache_flush()
+#define dns_cache_lookup(domain, port, addr) false
+#define dns_cache_store(domain, port, addr)
+#define dns_cache_invalidate(domain, port)
+#endif
+
+static bool http_init(void);
+static void http_wake(void);
+
+/* A node requests can be sent to. Slot 0 is configured with the
+ * nano_rest_set_remote_* functions, the others with nano_rest_add_endpoint.
+ * Guarded by http_state_lock. */
+typedef struct http_endpoint_t {
+    char *domain;
+    uint16_t port;
+    char *path;
+    char *post_prefix; // see POST_PREFIX_FORMAT_STR
+    size_t post_prefix_len;
+    uint16_t gen; // bumped whenever the node changes
+    // Health, maintained by the http_rest task
+    uint32_t srtt_us; // smoothed response time, 0 until measured
+    uint8_t fails; // consecutive failures
+    TickType_t retry_at; // avoided until then after a failure
+} http_endpoint_t;
+
+static http_endpoint_t http_endpoints[CONFIG_NANO_REST_MAX_ENDPOINTS];
+
+/* Copy of an endpoint taken when a request is sent to it, so the settings
+ * may change in the meantime. The strings follow it in one allocation. */
+typedef struct http_target_t {
+    uint8_t index;
+    uint16_t gen;
+    uint16_t port;
+    char *domain;
+    char *path;
+    char *post_prefix;
+    size_t post_prefix_len;
+} http_target_t;
+
+static TickType_t http_deadline(uint32_t seconds) {
+    return xTaskGetTickCount() + pdMS_TO_TICKS(seconds * 1000);
+}
+
+static bool http_expired(TickType_t deadline, TickType_t now) {
+    return (int32_t)(deadline - now) <= 0;
+}
+
+static bool endpoint_usable(const http_endpoint_t *ep) {
+    return NULL != ep->domain && NULL != ep->path && NULL != ep->post_prefix;
+}
+
+/* Renders the header prefix shared by all POSTs to ep and forgets what is
+ * known about its health. Called with http_state_lock held. */
+static void endpoint_changed(http_endpoint_t *ep) {
+    if( NULL != ep->post_prefix ) {
+        free(ep->post_prefix);
     }
-    if( NULL != str ){
-        remote_path = malloc(strlen(str)+1);
-        strcpy(remote_path, str);
+    ep->post_prefix = NULL;
+    ep->post_prefix_len = 0;
+    ep->gen++;
+    ep->srtt_us = 0;
+    ep->fails = 0;
+    if( NULL == ep->domain || NULL == ep->path ) {
+        return;
     }
-    else{
-        remote_path = NULL;
+    size_t len = strlen(POST_PREFIX_FORMAT_STR) + strlen(ep->path) +
+            strlen(ep->domain) + 1;
+    ep->post_prefix = malloc(len);
+    if( NULL == ep->post_prefix ) {
+        ESP_LOGE(TAG, "Unable to allocate request header");
+        return;
     }
+    ep->post_prefix_len = snprintf(ep->post_prefix, len,
+            POST_PREFIX_FORMAT_STR, ep->path, ep->domain);
 }
 
-static char *http_request_task(int get_post, char *post_data,
-        char *result_data_buf, size_t result_data_buf_len) {
-    int s = -1; // socket descriptor
-    int r;
-    char *request_packet = NULL;
-    struct addrinfo *addrinfo = NULL;
-    char * func_result = NULL;
-    char *http_response = NULL;
-    char *http_response_new = NULL;
-    int http_response_len = 0;
-
-    if( 0 == get_post) {
-        size_t request_packet_len = strlen(GET_FORMAT_STR) + 
-                strlen(remote_path) + strlen(remote_domain) + 1;
-        request_packet = malloc( request_packet_len );
-        snprintf(request_packet, request_packet_len, GET_FORMAT_STR,
-                remote_path, remote_domain);
-    }
-    else if ( 1 == get_post ) {
-        // 5 is for the uint16 port
-        size_t request_packet_len = strlen(POST_FORMAT_STR) + 
-                strlen(remote_path) + strlen(remote_domain) +
-                strlen(post_data) + 5 + 1;
-        request_packet = malloc( request_packet_len );
-
-        size_t post_data_length = strlen((const char*)post_data);
-        // todo: possibility that this could be truncated
-        snprintf(request_packet, request_packet_len, POST_FORMAT_STR,
-                 remote_path, remote_domain, post_data_length, post_data);
-        ESP_LOGI(TAG, "POST Request Packet:\n%s", request_packet);
+static void endpoint_clear(http_endpoint_t *ep) {
+    if( NULL != ep->domain ) {
+        free(ep->domain);
+    }
+    if( NULL != ep->path ) {
+        free(ep->path);
+    }
+    ep->domain = NULL;
+    ep->path = NULL;
+    ep->port = 0;
+    endpoint_changed(ep);
+}
+
+/* Picks the node for a request: the one with the lowest smoothed response
+ * time among those not backing off after a failure, else the one that
+ * comes out of backoff first. Nodes in the exclude bitmask (by index) are
+ * skipped. Returns a copy to be freed by the caller, or NULL. */
+static http_target_t *endpoint_pick(uint32_t exclude) {
+    http_target_t *target = NULL;
+    http_endpoint_t *best = NULL;
+    bool best_ready = false;
+    TickType_t now = xTaskGetTickCount();
+
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    for( int i = 0; i < CONFIG_NANO_REST_MAX_ENDPOINTS; i++ ) {
+        http_endpoint_t *ep = &http_endpoints[i];
+        if( !endpoint_usable(ep) || (exclude & (1u << i)) ) {
+            continue;
+        }
+        // Unmeasured nodes have srtt_us 0, so they get probed first
+        bool ready = 0 == ep->fails || http_expired(ep->retry_at, now);
+        if( NULL == best || (ready && !best_ready) ||
+                (ready == best_ready && (ready ?
+                ep->srtt_us < best->srtt_us :
+                (int32_t)(ep->retry_at - best->retry_at) < 0)) ) {
+            best = ep;
+            best_ready = ready;
+        }
+    }
+    if( NULL != best ) {
+        size_t domain_len = strlen(best->domain);
+        size_t path_len = strlen(best->path);
+        target = malloc(sizeof(http_target_t) + domain_len + 1 + path_len + 1 +
+                best->post_prefix_len + 1);
+        if( NULL != target ) {
+            target->index = best - http_endpoints;
+            target->gen = best->gen;
+            target->port = best->port;
+            target->domain = (char *)&target[1];
+            strcpy(target->domain, best->domain);
+            target->path = target->domain + domain_len + 1;
+            strcpy(target->path, best->path);
+            target->post_prefix = target->path + path_len + 1;
+            memcpy(target->post_prefix, best->post_prefix,
+                    best->post_prefix_len + 1);
+            target->post_prefix_len = best->post_prefix_len;
+        }
+        else {
+            ESP_LOGE(TAG, "Unable to allocate request target");
+        }
+    }
+    xSemaphoreGive(http_state_lock);
+    return target;
+}
+
+/* Records how a node handled a request. On success us is its response
+ * time, or 0 if not measured; a failure makes the node sit out an
+ * exponentially growing backoff. */
+static void endpoint_report(const http_target_t *target, bool ok, uint32_t us) {
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    http_endpoint_t *ep = &http_endpoints[target->index];
+    if( ep->gen != target->gen ) {
+        goto exit; // reconfigured meanwhile
+    }
+    if( ok ) {
+        ep->fails = 0;
+        if( us > 0 ) {
+            // Same gain as TCP's smoothed RTT
+            ep->srtt_us = (0 == ep->srtt_us) ? us :
+                    ep->srtt_us + ((int64_t)us - ep->srtt_us) / 8;
+        }
     }
     else {
-        ESP_LOGE(TAG, "Error, POST/Get not selected");
-        goto exit;
+        if( ep->fails < UINT8_MAX ) {
+            ep->fails++;
+        }
+        uint32_t backoff = CONFIG_NANO_REST_BACKOFF_MIN;
+        for( int i = 1; i < ep->fails && backoff < CONFIG_NANO_REST_BACKOFF_MAX; i++ ) {
+            backoff *= 2;
+        }
+        if( backoff > CONFIG_NANO_REST_BACKOFF_MAX ) {
+            backoff = CONFIG_NANO_REST_BACKOFF_MAX;
+        }
+        ep->retry_at = http_deadline(backoff);
+        ESP_LOGW(TAG, "%s:%d failed %d time(s), avoiding it for %u s",
+                target->domain, target->port, ep->fails, (unsigned)backoff);
     }
-    {
-        const struct addrinfo hints = {
-            .ai_family = AF_INET,
-            .ai_socktype = SOCK_STREAM,
-        };
-        ESP_LOGI(TAG, "Performing DNS lookup");
-        ESP_LOGI(TAG, "Remote Domain: %s", remote_domain);
-        char port[10];
-        snprintf(port, sizeof(port), "%d", remote_port);
-        ESP_LOGI(TAG, "Remote Port: %s", port);
-        int err = getaddrinfo(remote_domain, port, &hints, &addrinfo);
-        ESP_LOGI(TAG, "DNS lookup success");
-        
-        if(err != 0 || addrinfo == NULL) {
-            ESP_LOGE(TAG, "DNS lookup failed err=%d addrinfo=%p", err, addrinfo);
-            goto exit;
+exit:
+    xSemaphoreGive(http_state_lock);
+}
+
+static char *http_strdup(const char *str) {
+    char *copy = NULL;
+    if( NULL != str ) {
+        copy = malloc(strlen(str) + 1);
+        if( NULL != copy ) {
+            strcpy(copy, str);
+        }
+    }
+    return copy;
+}
+
+void nano_rest_set_remote_domain(char *str){
+    if( !http_init() ) {
+        return;
+    }
+    char *new_domain = http_strdup(str);
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    dns_cache_flush();
+    http_endpoint_t *ep = &http_endpoints[0];
+    if( NULL != ep->domain ){
+        free(ep->domain);
+    }
+    ep->domain = new_domain;
+    endpoint_changed(ep);
+    xSemaphoreGive(http_state_lock);
+}
+
+void nano_rest_set_remote_port(uint16_t port){
+    if( !http_init() ) {
+        return;
+    }
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    dns_cache_flush();
+    http_endpoints[0].port = port;
+    endpoint_changed(&http_endpoints[0]);
+    xSemaphoreGive(http_state_lock);
+}
+
+void nano_rest_set_remote_path(char *str){
+    if( !http_init() ) {
+        return;
+    }
+    char *new_path = http_strdup(str);
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    http_endpoint_t *ep = &http_endpoints[0];
+    if( NULL != ep->path ){
+        free(ep->path);
+    }
+    ep->path = new_path;
+    endpoint_changed(ep);
+    xSemaphoreGive(http_state_lock);
+}
+
+int nano_rest_add_endpoint(const char *domain, uint16_t port,
+        const char *path) {
+    int res = -1;
+    if( NULL == domain || NULL == path || !http_init() ) {
+        return -1;
+    }
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    for( int i = 1; i < CONFIG_NANO_REST_MAX_ENDPOINTS; i++ ) {
+        http_endpoint_t *ep = &http_endpoints[i];
+        if( NULL != ep->domain ) {
+            continue;
+        }
+        ep->domain = http_strdup(domain);
+        ep->path = http_strdup(path);
+        ep->port = port;
+        endpoint_changed(ep);
+        if( endpoint_usable(ep) ) {
+            res = 0;
         }
         else {
-            ESP_LOGI(TAG, "DNS lookup success");
+            endpoint_clear(ep);
+        }
+        break;
+    }
+    xSemaphoreGive(http_state_lock);
+    if( res < 0 ) {
+        ESP_LOGE(TAG, "Unable to add endpoint %s:%d", domain, port);
+    }
+    return res;
+}
+
+void nano_rest_clear_endpoints(void) {
+    if( !http_init() ) {
+        return;
+    }
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    for( int i = 1; i < CONFIG_NANO_REST_MAX_ENDPOINTS; i++ ) {
+        endpoint_clear(&http_endpoints[i]);
+    }
+    xSemaphoreGive(http_state_lock);
+}
+
+/* Read-only RPCs, which may be sent again or to another node */
+static const char *const http_idempotent_actions[] = {
+    "account_balance", "account_block_count", "account_get",
+    "account_history", "account_info", "account_key",
+    "account_representative", "account_weight", "accounts_balances",
+    "accounts_frontiers", "accounts_pending", "active_difficulty",
+    "available_supply", "block_account", "block_count", "block_info",
+    "blocks", "blocks_info", "chain", "delegators", "delegators_count",
+    "frontier_count", "frontiers", "pending", "pending_exists",
+    "representatives", "representatives_online", "successors",
+    "validate_account_number", "version",
+};
+
+/* Finds the action of the RPC in body, a top-level member so that one
+ * inside a string or a nested value is not mistaken for it. Returns its
+ * name, which is *len characters long, or NULL. */
+static const char *http_rpc_action(const char *body, size_t *len) {
+    const char *end = NULL;
+    const char *p = json_find_member(body, "action", &end);
+    if( NULL == p || '"' != *p ) {
+        return NULL;
+    }
+    *len = end - p - 2;
+    return p + 1;
+}
+
+/* Whether the RPC action only reads from the node */
+static bool http_rpc_idempotent(const char *action, size_t len) {
+    for( size_t i = 0; i < sizeof(http_idempotent_actions) /
+            sizeof(http_idempotent_actions[0]); i++ ) {
+        const char *name = http_idempotent_actions[i];
+        if( strlen(name) == len && 0 == strncmp(name, action, len) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Persistent connection pool. Idle sockets are kept per (domain, port) so
+ * consecutive RPCs to the same node skip DNS and the TCP handshake. */
+typedef struct http_conn_t {
+    int s;
+    char *domain;
+    uint16_t port;
+    bool in_use;
+    TickType_t last_used;
+} http_conn_t;
+
+#if CONFIG_NANO_REST_KEEP_ALIVE
+static http_conn_t conn_pool[CONFIG_NANO_REST_POOL_SIZE];
+
+/* Returns true if an idle socket is still usable. A readable socket with no
+ * pending request means the peer either closed (half-closed, recv returns 0)
+ * or sent something unsolicited; neither can be reused. */
+static bool conn_is_alive(int s) {
+    char c;
+    int r = recv(s, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if( r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+        return true;
+    }
+    return false;
+}
+
+static void conn_slot_clear(http_conn_t *slot) {
+    if( NULL != slot->domain && slot->s >= 0 ) {
+        close(slot->s);
+    }
+    if( NULL != slot->domain ) {
+        free(slot->domain);
+    }
+    slot->s = -1;
+    slot->domain = NULL;
+    slot->port = 0;
+    slot->in_use = false;
+}
+
+/* Takes an idle, still-connected socket for domain:port out of the pool.
+ * Stale entries encountered along the way are closed. */
+static http_conn_t *conn_pool_take_idle(const char *domain, uint16_t port) {
+    TickType_t now = xTaskGetTickCount();
+    for( int i = 0; i < CONFIG_NANO_REST_POOL_SIZE; i++ ) {
+        http_conn_t *slot = &conn_pool[i];
+        if( slot->in_use || NULL == slot->domain ) {
+            continue;
+        }
+        if( now - slot->last_used >
+                pdMS_TO_TICKS(CONFIG_NANO_REST_POOL_IDLE_TIMEOUT * 1000) ||
+                !conn_is_alive(slot->s) ) {
+            ESP_LOGI(TAG, "Dropping stale pooled connection to %s:%d",
+                    slot->domain, slot->port);
+            conn_slot_clear(slot);
+            continue;
         }
+        if( port == slot->port && 0 == strcmp(domain, slot->domain) ) {
+            slot->in_use = true;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/* Claims a slot for a freshly connected socket, evicting the least recently
+ * used idle connection if the pool is full. Returns NULL if every slot is
+ * busy; the caller then uses an unpooled connection. */
+static http_conn_t *conn_pool_claim(const char *domain, uint16_t port) {
+    http_conn_t *victim = NULL;
+    for( int i = 0; i < CONFIG_NANO_REST_POOL_SIZE; i++ ) {
+        http_conn_t *slot = &conn_pool[i];
+        if( slot->in_use ) {
+            continue;
+        }
+        if( NULL == slot->domain ) {
+            victim = slot;
+            break;
+        }
+        // Tick counts wrap, so compare the difference
+        if( NULL == victim ||
+                (int32_t)(slot->last_used - victim->last_used) < 0 ) {
+            victim = slot;
+        }
+    }
+    if( NULL == victim ) {
+        return NULL;
+    }
+    conn_slot_clear(victim);
+    victim->domain = malloc(strlen(domain)+1);
+    if( NULL == victim->domain ) {
+        return NULL;
+    }
+    strcpy(victim->domain, domain);
+    victim->port = port;
+    victim->in_use = true;
+    return victim;
+}
+#endif
+
+/* Resolves domain:port to an IPv4 address, consulting the DNS cache first.
+ * Returns 0 on success. */
+static int dns_resolve(const char *domain, uint16_t port,
+        struct sockaddr_in *addr) {
+    struct addrinfo *addrinfo = NULL;
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    bool hit = dns_cache_lookup(domain, port, addr);
+    xSemaphoreGive(http_state_lock);
+    if( hit ) {
+        ESP_LOGD(TAG, "DNS cache hit. IP=%s", inet_ntoa(addr->sin_addr));
+        TRACE_COUNT(dns_cache_hits);
+        return 0;
     }
+
+    ESP_LOGD(TAG, "Performing DNS lookup");
+    ESP_LOGD(TAG, "Remote Domain: %s", domain);
+    char port_str[10];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    ESP_LOGD(TAG, "Remote Port: %s", port_str);
+    int64_t started = stats_now();
+    TRACE_COUNT(dns_lookups);
+    int err = getaddrinfo(domain, port_str, &hints, &addrinfo);
     
+    if(err != 0 || addrinfo == NULL) {
+        ESP_LOGE(TAG, "DNS lookup failed err=%d addrinfo=%p", err, addrinfo);
+        if( addrinfo ) {
+            freeaddrinfo(addrinfo);
+        }
+        return -1;
+    }
+    memcpy(addr, addrinfo->ai_addr, sizeof(*addr));
+    freeaddrinfo(addrinfo);
+    stats_record(NANO_REST_PHASE_DNS, started);
+
     /* Code to print the resolved IP.
      Note: inet_ntoa is non-reentrant, look at ipaddr_ntoa_r for "real" code */
-    {
-        struct in_addr *addr;
-        addr = &((struct sockaddr_in *)addrinfo->ai_addr)->sin_addr;
-        ESP_LOGI(TAG, "DNS lookup succeeded. IP=%s", inet_ntoa(*addr));
+    ESP_LOGD(TAG, "DNS lookup succeeded. IP=%s", inet_ntoa(addr->sin_addr));
+
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    dns_cache_store(domain, port, addr);
+    xSemaphoreGive(http_state_lock);
+    return 0;
+}
+
+/* Resolves domain:port and starts connecting a non-blocking socket to it.
+ * Returns the socket or -1. *pending is set if the connection is still
+ * being established; the socket then becomes writable once it is done,
+ * see conn_finish_connect. */
+static int conn_connect(const char *domain, uint16_t port, bool *pending) {
+    int s = -1;
+    struct sockaddr_in addr;
+
+    *pending = false;
+    if( 0 != dns_resolve(domain, port, &addr) ) {
+        return -1;
     }
     
     /* Open Socket Connection */
-    s = socket(addrinfo->ai_family, addrinfo->ai_socktype, 0);
+    s = socket(AF_INET, SOCK_STREAM, 0);
     if( s < 0 ) {
         ESP_LOGE(TAG, "... Failed to allocate socket.");
-        goto exit;
+        return -1;
+    }
+    ESP_LOGD(TAG, "... allocated socket");
+    if( fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) < 0 ) {
+        ESP_LOGE(TAG, "... failed to make socket non-blocking");
+        close(s);
+        return -1;
     }
-    ESP_LOGI(TAG, "... allocated socket");
-    if( 0 != connect(s, addrinfo->ai_addr, addrinfo->ai_addrlen) ) {
+#if CONFIG_NANO_REST_TCP_NODELAY
+    {
+        int nodelay = 1;
+        if( setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                sizeof(nodelay)) < 0 ) {
+            ESP_LOGW(TAG, "... failed to disable Nagle's algorithm");
+        }
+    }
+#endif
+    if( 0 != connect(s, (struct sockaddr *)&addr, sizeof(addr)) ) {
+        if( EINPROGRESS == errno ) {
+            *pending = true;
+            return s;
+        }
         ESP_LOGE(TAG, "... socket connect failed errno=%d", errno);
-        goto exit;
+        // The node may have moved; resolve again next time.
+        xSemaphoreTake(http_state_lock, portMAX_DELAY);
+        dns_cache_invalidate(domain, port);
+        xSemaphoreGive(http_state_lock);
+        close(s);
+        return -1;
     }
     ESP_LOGI(TAG, "... connected");
-    freeaddrinfo(addrinfo);
-    addrinfo = NULL;
-    
-    /* Write Request to Socket */
-    if (write(s, request_packet, strlen(request_packet)) < 0) {
-        ESP_LOGE(TAG, "... socket send failed");
-        goto exit;
+    return s;
+}
+
+/* Checks the outcome of a pending connect once s is writable, or after
+ * giving up on it if timed_out. Returns 0 if the connection is up. */
+static int conn_finish_connect(int s, const char *domain, uint16_t port,
+        bool timed_out) {
+    int err = ETIMEDOUT;
+    socklen_t err_len = sizeof(err);
+    if( !timed_out && 0 != getsockopt(s, SOL_SOCKET, SO_ERROR,
+            &err, &err_len) ) {
+        err = errno;
     }
-    ESP_LOGI(TAG, "... socket send success");
-    
-    {
-        struct timeval receiving_timeout;
-        receiving_timeout.tv_sec = CONFIG_NANO_REST_RECEIVE_TIMEOUT;
-        receiving_timeout.tv_usec = 0;
-        if (setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &receiving_timeout,
-                       sizeof(receiving_timeout)) < 0) {
-            ESP_LOGE(TAG, "... failed to set socket receiving timeout");
-            goto exit;
+    if( timed_out || 0 != err ) {
+        ESP_LOGE(TAG, "... socket connect failed errno=%d", err);
+        // The node may have moved; resolve again next time.
+        xSemaphoreTake(http_state_lock, portMAX_DELAY);
+        dns_cache_invalidate(domain, port);
+        xSemaphoreGive(http_state_lock);
+        return -1;
+    }
+    ESP_LOGI(TAG, "... connected");
+    return 0;
+}
+
+/* Returns a socket for domain:port, reusing a pooled connection when one
+ * is idle. *slot is set to the pool slot backing the socket (NULL for an
+ * unpooled connection), *reused to whether it was already open and
+ * *pending to whether conn_connect is still in progress. */
+static int conn_open(const char *domain, uint16_t port,
+        http_conn_t **slot, bool *reused, bool *pending) {
+    *slot = NULL;
+    *reused = false;
+    *pending = false;
+#if CONFIG_NANO_REST_KEEP_ALIVE
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    *slot = conn_pool_take_idle(domain, port);
+    xSemaphoreGive(http_state_lock);
+    if( NULL != *slot ) {
+        ESP_LOGD(TAG, "... reusing pooled connection");
+        *reused = true;
+        return (*slot)->s;
+    }
+#endif
+    int s = conn_connect(domain, port, pending);
+#if CONFIG_NANO_REST_KEEP_ALIVE
+    if( s >= 0 ) {
+        xSemaphoreTake(http_state_lock, portMAX_DELAY);
+        *slot = conn_pool_claim(domain, port);
+        if( NULL != *slot ) {
+            (*slot)->s = s;
         }
-        ESP_LOGI(TAG, "... set socket receiving timeout success");
+        xSemaphoreGive(http_state_lock);
     }
+#endif
+    return s;
+}
 
-    /* Read HTTP response */
-    do {
-        http_response_new = realloc(http_response, http_response_len + CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE);
-        if( NULL == http_response_new ) {
-            ESP_LOGE(TAG, "Unable to allocate additional memory for http_response");
-            goto exit;
+/* Returns a socket obtained from conn_open. If keep is set the connection
+ * is parked in the pool for the next request, otherwise it is closed. */
+static void conn_release(int s, http_conn_t *slot, bool keep) {
+    if( NULL == slot ) {
+        close(s);
+    }
+#if CONFIG_NANO_REST_KEEP_ALIVE
+    else {
+        xSemaphoreTake(http_state_lock, portMAX_DELAY);
+        if( keep ) {
+            slot->in_use = false;
+            slot->last_used = xTaskGetTickCount();
         }
         else {
-            http_response = http_response_new;
-        }
-        char recv_buf[CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE] = { 0 };
-        r = read(s, recv_buf, sizeof(recv_buf)-1);
-        memcpy(&http_response[http_response_len], recv_buf, r);
-        http_response_len += r;
-    } while( r == CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE - 1 );
-    ESP_LOGI(TAG, "... done reading from socket. Last read return=%d errno=%d\r\n", r, errno);
-   
-    {
-        int ret, minor_version, status;
-        struct phr_header headers[100];
-        const char* msg;
-        size_t msg_len, num_headers;
-        
-        num_headers = sizeof(headers) / sizeof(headers[0]);
-        ret = phr_parse_response(http_response, strlen(http_response), 
-                &minor_version, &status, 
-                &msg, &msg_len,
-                headers, &num_headers, 0);
-        int msg_size = http_response_len - ret;
-        ESP_LOGI(TAG, "Message Size: %d", msg_size);
-
-        if(result_data_buf_len > msg_size) {
-            strncpy((char *)result_data_buf, (char *)&http_response[ret], msg_size);
-            result_data_buf[msg_size] = '\0';
+            conn_slot_clear(slot);
         }
-        else {
-            ESP_LOGE(TAG, "Insufficient result buffer.");
-            goto exit;
+        xSemaphoreGive(http_state_lock);
+    }
+#endif
+}
+
+/* A response being received. The status line and headers are read into a
+ * small scratch area; the body goes straight to its destination, which is
+ * either the caller's result buffer or, if body_owned, a heap buffer that
+ * is grown as needed. */
+typedef struct http_rx_t {
+    char *body;
+    size_t body_len; // decoded body bytes so far
+    size_t body_cap; // excluding the terminator
+    bool body_owned;
+    nano_rest_chunk_cb_t on_chunk; // if set, the body is streamed instead
+    void *chunk_ctx;
+    int received; // raw bytes read from the socket
+    // Parsed from the headers
+    int status;
+    int content_length; // -1 if absent
+    bool chunked;
+    bool keep_alive;
+    struct phr_chunked_decoder decoder;
+    // Progress through the response
+    bool in_body;
+    size_t hdr_parsed; // scratch bytes the header parser has seen
+    uint32_t parse_us; // time spent in the parser
+} http_rx_t;
+
+/* Parses the status line and headers buffered in hdr; last_len is how much
+ * of it was already looked at by the previous call. Returns the header
+ * length once complete, -2 if more data is needed and -1 on error. */
+static int http_parse_headers(const char *hdr, size_t hdr_len, size_t last_len,
+        http_rx_t *rx) {
+    int minor_version;
+    struct phr_header headers[100];
+    const char* msg;
+    size_t msg_len;
+    size_t num_headers = sizeof(headers) / sizeof(headers[0]);
+    // Framing headers are picked out by the parser as it goes
+    struct phr_known_headers known;
+    int ret = phr_parse_response_ex(hdr, hdr_len,
+            &minor_version, &rx->status, &msg, &msg_len,
+            headers, &num_headers, last_len, &known);
+    if( ret < 0 ) {
+        return ret;
+    }
+    if( known.content_length > INT_MAX ) {
+        return -1;
+    }
+    rx->content_length = known.content_length;
+    rx->chunked = 0 != (known.flags & PHR_FLAG_CHUNKED);
+    rx->keep_alive = 0 != (known.flags & PHR_FLAG_KEEP_ALIVE);
+    if( rx->chunked ) {
+        // Chunked framing takes precedence over Content-Length
+        rx->content_length = -1;
+        memset(&rx->decoder, 0, sizeof(rx->decoder));
+        rx->decoder.consume_trailer = 1;
+    }
+    else if( rx->content_length < 0 ) {
+        // Body delimited by the server closing the connection
+        rx->keep_alive = false;
+    }
+    return ret;
+}
+
+/* Makes room for a body of n bytes. Owned buffers are sized exactly when
+ * the length is known up front and grow geometrically otherwise. */
+static bool http_body_reserve(http_rx_t *rx, size_t n) {
+    if( n <= rx->body_cap && NULL != rx->body ) {
+        return true;
+    }
+    if( !rx->body_owned ) {
+        ESP_LOGE(TAG, "Insufficient result buffer.");
+        return false;
+    }
+    size_t cap = 2 * rx->body_cap;
+    if( cap < n || rx->content_length >= 0 ) {
+        cap = n;
+    }
+    if( cap > CONFIG_NANO_REST_RECEIVE_MAX_SIZE ) {
+        cap = CONFIG_NANO_REST_RECEIVE_MAX_SIZE;
+    }
+    if( cap < n ) {
+        ESP_LOGE(TAG, "Response exceeds %d bytes",
+                CONFIG_NANO_REST_RECEIVE_MAX_SIZE);
+        return false;
+    }
+    char *body_new = realloc(rx->body, cap + 1);
+    if( NULL == body_new ) {
+        ESP_LOGE(TAG, "Unable to allocate additional memory for http_response");
+        return false;
+    }
+    rx->body = body_new;
+    rx->body_cap = cap;
+    return true;
+}
+
+/* Number of raw bytes to ask the socket for next, given that at most
+ * room bytes fit. Never reads past a Content-Length framed body. */
+static size_t http_body_want(const http_rx_t *rx, size_t room) {
+    if( rx->content_length >= 0 &&
+            room > rx->content_length - rx->body_len ) {
+        return rx->content_length - rx->body_len;
+    }
+    return room;
+}
+
+/* Accounts for *len raw body bytes just received at buf, decoding chunked
+ * framing in place (*len is updated to the decoded length). Bytes found
+ * after the end of a chunked body are left at buf + *len and counted in
+ * *extra. Returns 1 once the body is complete, 0 if more is expected and
+ * -1 on a framing error. */
+static int http_body_decode(http_rx_t *rx, char *buf, size_t *len,
+        size_t *extra) {
+    *extra = 0;
+    if( rx->chunked ) {
+        int64_t started = stats_now();
+        ssize_t ret = phr_decode_chunked(&rx->decoder, buf, len);
+        rx->parse_us += stats_now() - started;
+        if( -1 == ret ) {
+            ESP_LOGE(TAG, "Malformed chunked encoding");
+            return -1;
         }
-        ESP_LOGI(TAG, "phr_parse_response:\n%s", (char *) result_data_buf);
+        if( -2 == ret ) {
+            return 0;
+        }
+        *extra = ret;
+        return 1;
     }
-    func_result = result_data_buf;
-exit:
-    if( addrinfo ) {
-        freeaddrinfo(addrinfo);
+    if( rx->content_length >= 0 ) {
+        return rx->body_len + *len >= (size_t)rx->content_length;
     }
-    if( request_packet ) {
-        free(request_packet);
+    return 0;
+}
+
+/* Keeps the n bytes at src, which were read past the end of a response,
+ * at the front of the scratch area for the next response. */
+static void http_carry(char *hdr, size_t *hdr_len, const char *src, size_t n) {
+    memmove(hdr, src, n);
+    *hdr_len = n;
+}
+
+/* Sockets are non-blocking; HTTP_AGAIN means come back once readable */
+#define HTTP_AGAIN (-2)
+
+static int http_read(int s, char *buf, size_t len, http_rx_t *rx) {
+    int r = read(s, buf, len);
+    if( r < 0 && (EAGAIN == errno || EWOULDBLOCK == errno) ) {
+        return HTTP_AGAIN;
     }
-    if( s >= 0 ) {
-        close(s);
+    if( r > 0 ) {
+        rx->received += r;
+        TRACE_ADD(bytes_received, r);
     }
-    if( http_response ) {
-        free(http_response);
+    return r;
+}
+
+/* Prepares rx for the next response on a connection. Bytes carried over
+ * in the scratch area are parsed by the next http_rx_step. */
+static void http_rx_begin(http_rx_t *rx) {
+    rx->body_len = 0;
+    rx->received = 0;
+    rx->keep_alive = false;
+    rx->content_length = -1;
+    rx->chunked = false;
+    rx->in_body = false;
+    rx->hdr_parsed = 0;
+    rx->parse_us = 0;
+}
+
+/* Streams the body to rx->on_chunk. The header scratch area is reused as
+ * the receive buffer, so memory use does not depend on the body size.
+ * data holds avail body bytes already read into hdr. */
+static int http_rx_stream(int s, http_rx_t *rx, char *hdr, size_t *hdr_len,
+        char *data, size_t avail) {
+    for( ;; ) {
+        size_t len = http_body_want(rx, avail);
+        size_t extra = avail - len;
+        size_t tail;
+        int done = http_body_decode(rx, data, &len, &tail);
+        if( done < 0 ) {
+            rx->keep_alive = false;
+            return -1;
+        }
+        if( len > 0 ) {
+            rx->on_chunk(data, len, rx->chunk_ctx);
+            rx->body_len += len;
+        }
+        if( done ) {
+            http_carry(hdr, hdr_len, &data[len], extra + tail);
+            ESP_LOGD(TAG, "... done streaming from socket");
+            return 1;
+        }
+        *hdr_len = 0;
+        int r = http_read(s, hdr, http_body_want(rx, CONFIG_NANO_REST_HEADER_BUF_SIZE), rx);
+        if( HTTP_AGAIN == r ) {
+            return 0;
+        }
+        if( 0 == r && rx->content_length < 0 && !rx->chunked ) {
+            // Body delimited by the server closing the connection
+            ESP_LOGD(TAG, "... done streaming from socket");
+            return 1;
+        }
+        if( r <= 0 ) {
+            ESP_LOGE(TAG, "... response truncated. return=%d errno=%d", r, errno);
+            rx->keep_alive = false;
+            return -1;
+        }
+        data = hdr;
+        avail = r;
     }
-    return func_result;
 }
 
-static void http_request_task_wrapper(void *args_in) {
-    task_args_t *args = args_in;
-    http_request_task(args->get_post, args->post_data,
-            args->result_data_buf, args->result_data_buf_len);
-    xSemaphoreGive(http_request_complete);
-    vTaskDelete(NULL);
+/* Reads the rest of the body in place */
+static int http_rx_body(int s, http_rx_t *rx, char *hdr, size_t *hdr_len) {
+    int r;
+    int done = 0;
+    size_t len, tail;
+
+    while( !done ) {
+        size_t room;
+        if( rx->body_owned ) {
+            if( !http_body_reserve(rx, rx->body_len +
+                    http_body_want(rx, CONFIG_NANO_REST_RECEIVE_BLOCK_SIZE)) ) {
+                rx->keep_alive = false;
+                return -1;
+            }
+        }
+        room = rx->body_cap - rx->body_len;
+        if( 0 == room && rx->chunked ) {
+            /* A full caller buffer may still be followed by chunk framing;
+             * decode it in the scratch area, it must not add any data */
+            r = http_read(s, hdr, CONFIG_NANO_REST_HEADER_BUF_SIZE, rx);
+            if( HTTP_AGAIN == r ) {
+                return 0;
+            }
+            if( r <= 0 ) {
+                ESP_LOGE(TAG, "... response truncated. return=%d errno=%d", r, errno);
+                rx->keep_alive = false;
+                return -1;
+            }
+            len = r;
+            done = http_body_decode(rx, hdr, &len, &tail);
+            if( done < 0 || len > 0 ) {
+                if( len > 0 ) {
+                    ESP_LOGE(TAG, "Insufficient result buffer.");
+                }
+                rx->keep_alive = false;
+                return -1;
+            }
+            *hdr_len = tail; // already at the front
+            continue;
+        }
+        if( 0 == room ) {
+            ESP_LOGE(TAG, "Insufficient result buffer.");
+            rx->keep_alive = false;
+            return -1;
+        }
+        room = http_body_want(rx, room);
+        if( rx->chunked && room > CONFIG_NANO_REST_HEADER_BUF_SIZE ) {
+            // Anything read past the last chunk must fit the scratch area
+            room = CONFIG_NANO_REST_HEADER_BUF_SIZE;
+        }
+        r = http_read(s, &rx->body[rx->body_len], room, rx);
+        if( HTTP_AGAIN == r ) {
+            return 0;
+        }
+        if( 0 == r && rx->content_length < 0 && !rx->chunked ) {
+            break; // body delimited by the server closing the connection
+        }
+        if( r <= 0 ) {
+            ESP_LOGE(TAG, "... response truncated. return=%d errno=%d", r, errno);
+            rx->keep_alive = false;
+            return -1;
+        }
+        len = r;
+        done = http_body_decode(rx, &rx->body[rx->body_len], &len, &tail);
+        if( done < 0 ) {
+            rx->keep_alive = false;
+            return -1;
+        }
+        if( tail > 0 ) {
+            http_carry(hdr, hdr_len, &rx->body[rx->body_len + len], tail);
+        }
+        rx->body_len += len;
+    }
+    ESP_LOGD(TAG, "... done reading from socket");
+    rx->body[rx->body_len] = '\0';
+    return 1;
 }
 
-int network_get_data(char *post_data,
-        char *result_data_buf, size_t result_data_buf_len){
-    if( NULL == http_request_complete ) {
-        ESP_LOGI(TAG, "Creating http_request_complete binary semaphore");
-        http_request_complete = xSemaphoreCreateBinary();
-    }
-    task_args_t t = {
-        .get_post = 1,
-        .post_data = post_data,
-        .result_data_buf = result_data_buf,
-        .result_data_buf_len = result_data_buf_len
-    };
-    TaskHandle_t h;
+/* Makes as much progress on the response as the socket allows without
+ * blocking. The headers are parsed incrementally as they arrive, and the
+ * body is framed by Content-Length, chunked encoding or the server closing
+ * the connection. hdr is a scratch area of CONFIG_NANO_REST_HEADER_BUF_SIZE
+ * bytes holding *hdr_len bytes already received; once the response is
+ * complete it holds whatever followed it, i.e. the start of the next one
+ * on a pipelined connection. The body is NUL-terminated unless streamed.
+ * Returns 1 once the response is complete, 0 if more is expected and -1
+ * on failure, which includes a status other than 2xx; rx->keep_alive
+ * tells whether s may be reused. */
+static int http_rx_step(int s, http_rx_t *rx, char *hdr, size_t *hdr_len) {
+    int header_len = -2;
 
-    xTaskCreate(http_request_task_wrapper,
-            "http_rest", 16000, //todo: optimize this number
-            (void *)&t, 10, &h);
-    if( xSemaphoreTake( http_request_complete, 
-            pdMS_TO_TICKS(CONFIG_NANO_REST_RECEIVE_TIMEOUT * 1000)) ) {
-        return 0;
+    /* Read the status line and headers */
+    while( !rx->in_body ) {
+        if( *hdr_len > rx->hdr_parsed ) {
+            int64_t started = stats_now();
+            header_len = http_parse_headers(hdr, *hdr_len, rx->hdr_parsed, rx);
+            rx->parse_us += stats_now() - started;
+            rx->hdr_parsed = *hdr_len;
+            if( -1 == header_len ) {
+                ESP_LOGE(TAG, "Malformed response headers");
+                rx->keep_alive = false;
+                return -1;
+            }
+            if( header_len >= 0 && (rx->status < 200 || rx->status > 299) ) {
+                // An error page, say from a proxy in front of a broken node
+                ESP_LOGE(TAG, "Server answered HTTP %d", rx->status);
+                rx->keep_alive = false;
+                return -1;
+            }
+            if( header_len >= 0 ) {
+                rx->in_body = true;
+                break;
+            }
+        }
+        if( *hdr_len == CONFIG_NANO_REST_HEADER_BUF_SIZE ) {
+            ESP_LOGE(TAG, "Response headers too large");
+            return -1;
+        }
+        int r = http_read(s, &hdr[*hdr_len],
+                CONFIG_NANO_REST_HEADER_BUF_SIZE - *hdr_len, rx);
+        if( HTTP_AGAIN == r ) {
+            return 0;
+        }
+        if( r <= 0 ) {
+            ESP_LOGE(TAG, "... read failed before end of headers. return=%d errno=%d", r, errno);
+            return -1;
+        }
+        *hdr_len += r;
     }
-    else {
-        // Timed out
-        vTaskDelete(h);
-        result_data_buf[0] = '\0';
-        ESP_LOGE(TAG, "HTTP Task timed out");
+    if( header_len < 0 ) {
+        // Headers were done on an earlier call
+        if( NULL != rx->on_chunk ) {
+            return http_rx_stream(s, rx, hdr, hdr_len, hdr, 0);
+        }
+        return http_rx_body(s, rx, hdr, hdr_len);
+    }
+
+    /* Whatever followed the headers in the scratch area starts the body */
+    if( NULL != rx->on_chunk ) {
+        return http_rx_stream(s, rx, hdr, hdr_len, &hdr[header_len],
+                *hdr_len - header_len);
+    }
+
+    if( rx->content_length >= 0 && !http_body_reserve(rx, rx->content_length) ) {
+        rx->keep_alive = false;
         return -1;
     }
+
+    // Decoded in the scratch area, since chunk framing may not fit the body
+    size_t len = http_body_want(rx, *hdr_len - header_len);
+    size_t extra = *hdr_len - header_len - len;
+    size_t tail;
+    int done = http_body_decode(rx, &hdr[header_len], &len, &tail);
+    if( done < 0 || !http_body_reserve(rx, len) ) {
+        rx->keep_alive = false;
+        return -1;
+    }
+    memcpy(rx->body, &hdr[header_len], len);
+    rx->body_len = len;
+    http_carry(hdr, hdr_len, &hdr[header_len + len], extra + tail);
+    if( done ) {
+        ESP_LOGD(TAG, "... done reading from socket");
+        rx->body[rx->body_len] = '\0';
+        return 1;
+    }
+    return http_rx_body(s, rx, hdr, hdr_len);
+}
+
+/* Points iov at the three pieces of a POST: the cached header prefix of
+ * the node it goes to, the Content-Length value rendered into length_buf,
+ * and the body, which is sent from where it is rather than copied into a
+ * request packet. */
+static void http_post_iov(struct iovec *iov, char *length_buf,
+        const http_target_t *target, const char *body, size_t body_len) {
+    iov[0].iov_base = target->post_prefix;
+    iov[0].iov_len = target->post_prefix_len;
+    iov[1].iov_base = length_buf;
+    iov[1].iov_len = snprintf(length_buf, POST_LENGTH_BUF_SIZE,
+            POST_LENGTH_FORMAT_STR, (unsigned)body_len);
+    iov[2].iov_base = (char *)body;
+    iov[2].iov_len = body_len;
+}
+
+/* Writes as much of iov[*i..iovcnt) as s takes without blocking, normally
+ * with a single writev; *offset is how much of iov[*i] already went out.
+ * After a short write the rest of a partly sent buffer goes out with
+ * MSG_MORE so the stack can coalesce it with what follows. iov itself is
+ * left untouched. Returns 1 once everything is sent, 0 if s has to become
+ * writable first and -1 on failure. */
+static int http_send(int s, const struct iovec *iov, int iovcnt,
+        int *i, size_t *offset) {
+    while( *i < iovcnt ) {
+        ssize_t r;
+        if( 0 == *offset ) {
+            r = writev(s, &iov[*i], iovcnt - *i);
+        }
+        else {
+            r = send(s, (char *)iov[*i].iov_base + *offset,
+                    iov[*i].iov_len - *offset, (*i + 1 < iovcnt) ? MSG_MORE : 0);
+        }
+        if( r < 0 ) {
+            if( EINTR == errno ) {
+                continue;
+            }
+            if( EAGAIN == errno || EWOULDBLOCK == errno ) {
+                return 0;
+            }
+            ESP_LOGE(TAG, "... socket send failed. errno=%d", errno);
+            return -1;
+        }
+        TRACE_ADD(bytes_sent, r);
+        *offset += r;
+        while( *i < iovcnt && *offset >= iov[*i].iov_len ) {
+            *offset -= iov[*i].iov_len;
+            (*i)++;
+        }
+    }
+    ESP_LOGD(TAG, "... socket send success");
+    return 1;
+}
+
+/* Allocates a job with post_data_size bytes for its request bodies, which
+ * the caller fills in before handing it to job_register */
+static task_args_t *job_alloc(size_t post_data_size, char *result_data_buf,
+        size_t result_data_buf_len, nano_rest_cb_t cb, void *cb_ctx) {
+    bool configured = false;
+    xSemaphoreTake(http_state_lock, portMAX_DELAY);
+    for( int i = 0; i < CONFIG_NANO_REST_MAX_ENDPOINTS; i++ ) {
+        configured |= endpoint_usable(&http_endpoints[i]);
+    }
+    xSemaphoreGive(http_state_lock);
+    if( !configured ) {
+        ESP_LOGE(TAG, "Remote domain/path not set");
+        return NULL;
+    }
+    task_args_t *job = calloc(1, sizeof(task_args_t));
+    if( NULL == job ) {
+        return NULL;
+    }
+    if( NULL == cb ) {
+        job->complete = xSemaphoreCreateBinary();
+        if( NULL == job->complete ) {
+            free(job);
+            return NULL;
+        }
+    }
+    job->post_data = malloc(post_data_size);
+    if( NULL == job->post_data ) {
+        if( job->complete ) {
+            vSemaphoreDelete(job->complete);
+        }
+        free(job);
+        return NULL;
+    }
+    job->idempotent = true;
+    job->result_data_buf = result_data_buf;
+    job->result_data_buf_len = result_data_buf_len;
+    job->cb = cb;
+    job->cb_ctx = cb_ctx;
+    job->result = -1;
+    job->s = -1;
+    return job;
+}
+
+/* Notes what one of the job's RPCs does, for failover and the response
+ * cache. action is NULL if unknown. */
+static void job_classify(task_args_t *job, const char *action,
+        size_t action_len, size_t n_post) {
+    if( NULL == action ) {
+        job->idempotent = false;
+        return;
+    }
+    job->idempotent &= http_rpc_idempotent(action, action_len);
+    job->writes |= cache_action_writes(action, action_len);
+    if( 1 == n_post ) {
+        job->cache = cache_policy(action, action_len);
+    }
+}
+
+/* Makes the job known to nano_rest_cancel. It is then referenced by the
+ * caller (if waiting) and the event loop. */
+static void job_register(task_args_t *job, int get_post) {
+    if( job->writes ) {
+        cache_invalidate();
+    }
+    job->cache_gen = cache_generation();
+    job->get_post = get_post;
+    job->refs = (NULL == job->cb) ? 2 : 1;
+
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    job->id = http_job_next_id++;
+    if( 0 == http_job_next_id ) {
+        http_job_next_id = 1;
+    }
+    job->next = http_jobs;
+    http_jobs = job;
+    xSemaphoreGive(http_job_lock);
+}
+
+/* post_data holds n_post request bodies; they are copied back-to-back,
+ * each NUL-terminated, into the job's own allocation. */
+static task_args_t *job_create(int get_post, char *const *post_data,
+        size_t n_post, char *result_data_buf, size_t result_data_buf_len,
+        nano_rest_cb_t cb, void *cb_ctx) {
+    size_t post_data_len = 0;
+    for( size_t i = 0; i < n_post; i++ ) {
+        post_data_len += (NULL == post_data[i]) ? 1 : strlen(post_data[i]) + 1;
+    }
+    task_args_t *job = job_alloc(post_data_len + 1, result_data_buf,
+            result_data_buf_len, cb, cb_ctx);
+    if( NULL == job ) {
+        return NULL;
+    }
+    char *dst = job->post_data;
+    for( size_t i = 0; i < n_post; i++ ) {
+        size_t len = (NULL == post_data[i]) ? 0 : strlen(post_data[i]);
+        if( len > 0 ) {
+            memcpy(dst, post_data[i], len);
+        }
+        dst[len] = '\0';
+        if( 1 == get_post ) {
+            size_t action_len = 0;
+            const char *action = http_rpc_action(dst, &action_len);
+            job_classify(job, action, action_len, n_post);
+        }
+        job->post_len = len;
+        dst += len + 1;
+    }
+    *dst = '\0';
+    job_register(job, get_post);
+    return job;
+}
+
+static void job_release(task_args_t *job) {
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    bool last = (0 == --job->refs);
+    if( last ) {
+        for( task_args_t **p = &http_jobs; NULL != *p; p = &(*p)->next ) {
+            if( *p == job ) {
+                *p = job->next;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(http_job_lock);
+    if( last ) {
+        if( job->complete ) {
+            vSemaphoreDelete(job->complete);
+        }
+        free(job->post_data);
+        free(job);
+    }
+}
+
+/* Requests cancellation. The event loop is woken up and drops the job at
+ * its next pass; shutting the socket down ends any exchange in progress. */
+static void job_cancel_locked(task_args_t *job) {
+    job->cancelled = true;
+    if( job->s >= 0 ) {
+        shutdown(job->s, SHUT_RDWR);
+    }
+    http_wake();
+}
+
+/* Hands the response body to an asynchronous requester. A blocking
+ * request's body has already been received into the caller's buffer or
+ * streamed to its chunk callback. */
+static bool job_deliver(task_args_t *job, char *body, size_t body_len) {
+    if( NULL == job->cb ) {
+        return true;
+    }
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    bool cancelled = job->cancelled;
+    xSemaphoreGive(http_job_lock);
+    if( cancelled ) {
+        return false;
+    }
+    job->cb(0, body, body_len, job->cb_ctx);
+    job->cb = NULL;
+    return true;
+}
+
+/* Publishes the socket the event loop is using for the job (-1 when done
+ * with it). Returns false if the job has been cancelled in the meantime.
+ * The caller's result buffer is only written while a socket is published,
+ * so a caller that times out knows whether it has to wait for the loop. */
+static bool job_set_socket(task_args_t *job, int s) {
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    bool cancelled = job->cancelled;
+    job->s = cancelled ? -1 : s;
+    xSemaphoreGive(http_job_lock);
+    return !cancelled;
+}
+
+/* Phases of a job driven by the event loop */
+enum {
+    HTTP_PHASE_CONNECT,
+    HTTP_PHASE_SEND,
+    HTTP_PHASE_RECV,
+    HTTP_PHASE_DONE,
+};
+
+/* A job being driven by the http_rest task. The requests it sends are
+ * described by iov, which is allocated along with it. */
+typedef struct http_io_t {
+    task_args_t *job;
+    struct http_io_t *next;
+    uint8_t phase;
+    TickType_t phase_deadline;
+    TickType_t deadline; // for the job as a whole
+    int64_t started; // for latency statistics
+    int64_t phase_started;
+    int64_t body_started;
+    bool awaiting_first; // no byte of the response to the last send yet
+    // Node the requests go to
+    http_target_t *target;
+    uint32_t tried; // bitmask of endpoint indices
+    int64_t sent_at; // last send completed, for the node's response time
+    bool measure; // next response is the first to the last send
+    // Hedging; see io_hedge
+    struct http_io_t *peer; // other copy of the request, if any
+    bool hedge; // this is the copy, so it stays out of the job's state
+    bool hedge_armed; // send a copy at hedge_at unless answered by then
+    TickType_t hedge_at;
+    // Connection
+    int s;
+    http_conn_t *conn;
+    bool reused; // s came from the pool
+    bool retried; // a stale pooled connection has been replaced already
+    bool got_data; // anything received on s
+    bool keep_alive;
+    // Requests; more than one for a pipelined batch
+    size_t n;
+    size_t answered; // requests with a complete response
+    size_t conn_first; // first request sent on s
+    size_t sent; // requests before this one are being or have been sent
+    int n_ok;
+    struct iovec *iov;
+    int iov_per_req;
+    int send_i; // next iovec to write
+    size_t send_offset; // how much of it has been written
+    char *request_packet; // GET only
+    // Response being received
+    http_rx_t rx;
+    size_t hdr_len;
+    char hdr[CONFIG_NANO_REST_HEADER_BUF_SIZE];
+} http_io_t;
+
+static void io_connect(http_io_t *io);
+
+/* Drops the loop's reference to a job that ended, reporting failure to an
+ * asynchronous requester that has not been called yet. */
+static void job_finish(task_args_t *job) {
+    if( job->writes ) {
+        // Whatever the outcome, the node may have published the block
+        cache_invalidate();
+    }
+    if( NULL != job->cb ) {
+        // Failed or cancelled before delivery
+        job->cb(-1, NULL, 0, job->cb_ctx);
+    }
+    if( NULL != job->complete ) {
+        xSemaphoreGive(job->complete);
+    }
+    job_release(job);
+}
+
+/* Addresses the requests to target, which io takes over */
+static bool io_set_target(http_io_t *io, http_target_t *target) {
+    task_args_t *job = io->job;
+    if( NULL != io->target ) {
+        free(io->target);
+    }
+    io->target = target;
+    io->tried |= 1u << target->index;
+
+    if( 0 == job->get_post ) {
+        size_t request_packet_len = strlen(GET_FORMAT_STR) +
+                strlen(target->path) + strlen(target->domain) + 1;
+        if( NULL != io->request_packet ) {
+            free(io->request_packet);
+        }
+        io->request_packet = malloc( request_packet_len );
+        if( NULL == io->request_packet ) {
+            return false;
+        }
+        io->iov[0].iov_base = io->request_packet;
+        io->iov[0].iov_len = snprintf(io->request_packet, request_packet_len,
+                GET_FORMAT_STR, target->path, target->domain);
+        return true;
+    }
+    // The request bodies are stored back-to-back in post_data
+    char *content_length = (char *)&io->iov[3 * io->n];
+    const char *post_data = job->post_data;
+    for( size_t i = 0; i < io->n; i++ ) {
+        size_t post_data_len = (1 == io->n) ? job->post_len : strlen(post_data);
+        http_post_iov(&io->iov[3 * i], &content_length[i * POST_LENGTH_BUF_SIZE],
+                target, post_data, post_data_len);
+        post_data += post_data_len + 1;
+    }
+    return true;
+}
+
+static http_io_t *io_create(task_args_t *job, http_target_t *target) {
+    if( 0 != job->get_post && 1 != job->get_post ) {
+        ESP_LOGE(TAG, "Error, POST/Get not selected");
+        free(target);
+        return NULL;
+    }
+    size_t n = (NULL != job->batch) ? job->batch_len : 1;
+    http_io_t *io = calloc(1, sizeof(http_io_t) +
+            n * (3 * sizeof(struct iovec) + POST_LENGTH_BUF_SIZE));
+    if( NULL == io ) {
+        ESP_LOGE(TAG, "Unable to allocate request state");
+        free(target);
+        return NULL;
+    }
+    io->job = job;
+    io->s = -1;
+    io->n = n;
+    io->deadline = http_deadline(CONFIG_NANO_REST_RECEIVE_TIMEOUT);
+    io->started = stats_now();
+    io->iov = (struct iovec *)&io[1];
+    io->iov_per_req = (0 == job->get_post) ? 1 : 3;
+    if( !io_set_target(io, target) ) {
+        free(io->target);
+        free(io);
+        return NULL;
+    }
+#if CONFIG_NANO_REST_LOG_PAYLOADS
+    for( size_t i = 0; 1 == job->get_post && i < n; i++ ) {
+        ESP_LOGI(TAG, "POST body:\n%s", (char *)io->iov[3 * i + 2].iov_base);
+    }
+#endif
+    return io;
+}
+
+#if CONFIG_NANO_REST_HEDGE
+/* How long to wait for the first byte before hedging a request */
+static uint32_t http_hedge_delay_ms(void) {
+#if CONFIG_NANO_REST_HEDGE_DELAY > 0
+    return CONFIG_NANO_REST_HEDGE_DELAY;
+#else
+    uint32_t ms = stats_p95_us(NANO_REST_PHASE_FIRST_BYTE) / 1000;
+    return (ms > CONFIG_NANO_REST_HEDGE_DELAY_MIN) ? ms :
+            CONFIG_NANO_REST_HEDGE_DELAY_MIN;
+#endif
+}
+#endif
+
+/* Publishes the socket io uses for the job, see job_set_socket. A hedge
+ * keeps out of it, the job's socket being its peer's; it just checks for
+ * cancellation. */
+static bool io_publish(http_io_t *io, int s) {
+    if( !io->hedge ) {
+        return job_set_socket(io->job, s);
+    }
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    bool cancelled = io->job->cancelled;
+    xSemaphoreGive(http_job_lock);
+    return !cancelled;
+}
+
+/* Lets go of everything io holds but its reference to the job */
+static void io_cleanup(http_io_t *io) {
+    if( io->s >= 0 ) {
+        io_publish(io, -1);
+        conn_release(io->s, io->conn, io->keep_alive);
+        io->s = -1;
+    }
+    if( io->rx.body_owned && io->rx.body ) {
+        free(io->rx.body);
+    }
+    if( io->request_packet ) {
+        free(io->request_packet);
+    }
+    free(io->target);
+    io->phase = HTTP_PHASE_DONE;
+}
+
+/* Ends one copy of a hedged request, leaving the job to the other. A
+ * hedge left on its own takes the job over: its socket is published and
+ * its body handed to the caller once complete. Returns false if the job
+ * has been cancelled in the meantime. */
+static bool io_drop(http_io_t *io) {
+    http_io_t *peer = io->peer;
+    peer->peer = NULL;
+    io->peer = NULL;
+    io->keep_alive = false;
+    io_cleanup(io);
+    job_release(io->job);
+    if( !peer->hedge ) {
+        return true;
+    }
+    peer->hedge = false;
+    return job_set_socket(peer->job, peer->s);
+}
+
+/* Ends the job and hands back its result. The loop frees io afterwards. */
+static void io_finish(http_io_t *io) {
+    task_args_t *job = io->job;
+    if( NULL != io->peer ) {
+        http_io_t *peer = io->peer;
+        if( !io_drop(io) && peer->s >= 0 ) {
+            // Cancelled before the hedge's socket could be shut down for it
+            peer->keep_alive = false;
+            shutdown(peer->s, SHUT_RDWR);
+        }
+        return;
+    }
+    job->result = (NULL != job->batch) ? io->n_ok : (io->n_ok ? 0 : -1);
+    if( io->n_ok > 0 ) {
+        stats_record(NANO_REST_PHASE_TOTAL, io->started);
+    }
+    if( (size_t)io->n_ok < io->n ) {
+        TRACE_COUNT(failures);
+    }
+    io_cleanup(io);
+    job_finish(job);
+}
+
+/* Lets go of the connection. Returns false if the job has been cancelled
+ * in the meantime. */
+static bool io_release_conn(http_io_t *io) {
+    bool ok = io_publish(io, -1);
+    if( !ok ) {
+        ESP_LOGI(TAG, "Request cancelled");
+        TRACE_COUNT(cancels);
+        io->keep_alive = false;
+    }
+    conn_release(io->s, io->conn, io->keep_alive);
+    io->s = -1;
+    return ok;
+}
+
+/* The node failed the outstanding requests. Marks it as failing and, if
+ * the job is safe to repeat, moves them to the next best node. */
+static void io_failover(http_io_t *io) {
+    task_args_t *job = io->job;
+    endpoint_report(io->target, false, 0);
+    if( !job->idempotent || NULL != io->peer ||
+            (NULL != job->on_chunk && io->rx.body_len > 0) ||
+            http_expired(io->deadline, xTaskGetTickCount()) ) {
+        // Streamed data cannot be taken back; a hedged peer carries on
+        io_finish(io);
+        return;
+    }
+    http_target_t *target = endpoint_pick(io->tried);
+    if( NULL == target ) {
+        io_finish(io);
+        return;
+    }
+    ESP_LOGW(TAG, "Failing over to %s:%d", target->domain, target->port);
+    TRACE_COUNT(failovers);
+    if( !io_set_target(io, target) ) {
+        io_finish(io);
+        return;
+    }
+    io->retried = false;
+    io_connect(io);
+}
+
+/* The connection broke or timed out before all responses were in. A
+ * pooled socket may have been closed by the server since its last use
+ * without us noticing; if it breaks before answering, retry once on a
+ * fresh connection to the same node. Anything else is the node's fault. */
+static void io_conn_failed(http_io_t *io, bool timed_out) {
+    bool stale = io->reused && !io->retried && !io->got_data &&
+            !timed_out && io->answered == io->conn_first;
+    io->keep_alive = false;
+    if( !io_release_conn(io) ) {
+        io_finish(io);
+        return;
+    }
+    if( !stale ) {
+        if( !io->got_data && HTTP_PHASE_CONNECT != io->phase ) {
+            ESP_LOGE(TAG, "... no response from server");
+        }
+        io_failover(io);
+        return;
+    }
+    ESP_LOGI(TAG, "... pooled connection went stale, reconnecting");
+    TRACE_COUNT(conn_retries);
+    io->retried = true;
+    io_connect(io);
+}
+
+/* Sets up rx for the response to request io->answered */
+static void io_rx_begin(http_io_t *io) {
+    task_args_t *job = io->job;
+    http_rx_t *rx = &io->rx;
+
+    if( io->hedge || rx->body_owned ) {
+        // A hedge's own buffer is copied to the caller's if it wins, and
+        // kept once it has taken the job over
+        rx->body_owned = true;
+    }
+    else if( NULL != job->batch ) {
+        rx->body = job->batch[io->answered].result_data_buf;
+        rx->body_cap = job->batch[io->answered].result_data_buf_len - 1;
+    }
+    else if( NULL != job->on_chunk ) {
+        rx->on_chunk = job->on_chunk;
+        rx->chunk_ctx = job->chunk_ctx;
+    }
+    else if( NULL == job->cb ) {
+        rx->body = job->result_data_buf;
+        rx->body_cap = job->result_data_buf_len - 1;
+    }
+    else {
+        rx->body_owned = true; // kept across retries
+    }
+    http_rx_begin(rx);
+    io->phase = HTTP_PHASE_RECV;
+    io->phase_deadline = http_deadline(CONFIG_NANO_REST_FIRST_BYTE_TIMEOUT);
+}
+
+/* io got its response first; the other copy of a hedged request is
+ * dropped. A winning hedge takes the job over. Returns false if the job
+ * has been cancelled in the meantime. */
+static bool io_win(http_io_t *io) {
+    task_args_t *job = io->job;
+    if( NULL != io->peer ) {
+        http_io_t *loser = io->peer;
+        if( loser->measure ) {
+            // Has taken at least this long, so that the next pick prefers io's node
+            endpoint_report(loser->target, true,
+                    esp_timer_get_time() - loser->sent_at);
+        }
+        if( io->hedge ) {
+            ESP_LOGI(TAG, "Hedged request to %s:%d answered first",
+                    io->target->domain, io->target->port);
+            TRACE_COUNT(hedge_wins);
+        }
+        if( !io_drop(loser) ) {
+            return false;
+        }
+    }
+    // A hedge receives into a buffer of its own, see io_rx_begin
+    if( io->rx.body_owned && NULL == job->cb ) {
+        if( io->rx.body_len >= job->result_data_buf_len ) {
+            ESP_LOGE(TAG, "Insufficient result buffer.");
+            return false;
+        }
+        memcpy(job->result_data_buf, io->rx.body, io->rx.body_len + 1);
+    }
+    return true;
+}
+
+/* Hands over the response just completed */
+static void io_deliver(http_io_t *io) {
+    task_args_t *job = io->job;
+    ESP_LOGD(TAG, "Message Size: %d", (int) io->rx.body_len);
+    if( NULL != job->batch ) {
+        job->batch[io->answered].status = 0;
+        io->n_ok++;
+    }
+    else {
+#if CONFIG_NANO_REST_LOG_PAYLOADS
+        if( NULL != io->rx.body ) {
+            ESP_LOGI(TAG, "phr_parse_response:\n%s", io->rx.body);
+        }
+#endif
+        if( NULL != job->cache && NULL == job->on_chunk &&
+                NULL != io->rx.body ) {
+            cache_store(job->post_data, job->cache, job->cache_gen,
+                    io->rx.status, io->rx.body, io->rx.body_len);
+        }
+        if( job_deliver(job, io->rx.body, io->rx.body_len) ) {
+            io->n_ok = 1;
+        }
+    }
+    io->answered++;
+}
+
+static void io_send(http_io_t *io) {
+    int ret = http_send(io->s, io->iov, io->sent * io->iov_per_req,
+            &io->send_i, &io->send_offset);
+    if( ret < 0 ) {
+        io_conn_failed(io, false);
+    }
+    else if( ret > 0 ) {
+        stats_record(NANO_REST_PHASE_SEND, io->phase_started);
+        io->phase_started = stats_now();
+        io->sent_at = esp_timer_get_time();
+        io->measure = true;
+        io->awaiting_first = true;
+#if CONFIG_NANO_REST_HEDGE
+        if( !io->hedge && NULL == io->peer && io->job->idempotent &&
+                NULL == io->job->batch && NULL == io->job->on_chunk ) {
+            io->hedge_armed = true;
+            io->hedge_at = xTaskGetTickCount() +
+                    pdMS_TO_TICKS(http_hedge_delay_ms());
+        }
+#endif
+        if( io->sent - io->answered > 1 ) {
+            ESP_LOGD(TAG, "... sent %d pipelined requests",
+                    (int)(io->sent - io->answered));
+        }
+        io_rx_begin(io);
+    }
+}
+
+/* Writes the next HTTP_PIPELINE_DEPTH requests still without a response */
+static void io_send_start(http_io_t *io) {
+    io->sent = io->answered + HTTP_PIPELINE_DEPTH;
+    if( io->sent > io->n ) {
+        io->sent = io->n;
+    }
+    io->send_i = io->answered * io->iov_per_req;
+    io->send_offset = 0;
+    io->phase = HTTP_PHASE_SEND;
+    io->phase_deadline = http_deadline(CONFIG_NANO_REST_SEND_TIMEOUT);
+    io->phase_started = stats_now();
+    io_send(io);
+}
+
+/* Opens a connection for the requests still without a response */
+static void io_connect(http_io_t *io) {
+    bool pending;
+
+    io->s = conn_open(io->target->domain, io->target->port,
+            &io->conn, &io->reused, &pending);
+    if( io->s < 0 ) {
+        io_failover(io);
+        return;
+    }
+    if( !io_publish(io, io->s) ) {
+        io->keep_alive = false;
+        io_finish(io);
+        return;
+    }
+    io->conn_first = io->answered;
+    io->got_data = false;
+    io->hdr_len = 0;
+    io->phase_started = stats_now();
+    if( pending ) {
+        io->phase = HTTP_PHASE_CONNECT;
+        io->phase_deadline = http_deadline(CONFIG_NANO_REST_CONNECT_TIMEOUT);
+        return;
+    }
+    if( io->reused ) {
+        TRACE_COUNT(conn_reuses);
+    }
+    else {
+        stats_record(NANO_REST_PHASE_CONNECT, io->phase_started);
+        TRACE_COUNT(connects);
+    }
+    io_send_start(io);
+}
+
+static void io_recv(http_io_t *io) {
+    for( ;; ) {
+        int ret = http_rx_step(io->s, &io->rx, io->hdr, &io->hdr_len);
+        if( io->rx.received > 0 ) {
+            io->got_data = true;
+            if( io->awaiting_first ) {
+                stats_record(NANO_REST_PHASE_FIRST_BYTE, io->phase_started);
+                io->body_started = stats_now();
+                io->awaiting_first = false;
+                io->hedge_armed = false;
+            }
+        }
+        if( 0 == ret ) {
+            if( io->rx.received > 0 || io->hdr_len > 0 ) {
+                // Past the first byte only the overall deadline applies
+                io->phase_deadline = io->deadline;
+            }
+            return;
+        }
+        if( ret < 0 ) {
+            io_conn_failed(io, false);
+            return;
+        }
+        if( io->measure ) {
+            endpoint_report(io->target, true,
+                    esp_timer_get_time() - io->sent_at);
+            io->measure = false;
+        }
+        stats_record(NANO_REST_PHASE_BODY, io->body_started);
+        stats_record_us(NANO_REST_PHASE_PARSE, io->rx.parse_us);
+        io->body_started = stats_now(); // next pipelined response
+        io->keep_alive = io->rx.keep_alive;
+        if( !io_win(io) ) {
+            io_finish(io);
+            return;
+        }
+        io_deliver(io);
+        if( io->answered == io->sent && io->hdr_len > 0 ) {
+            // More than we asked for; don't trust the connection
+            io->keep_alive = false;
+        }
+        if( io->answered == io->n ) {
+            io_finish(io);
+            return;
+        }
+        if( !io->keep_alive ) {
+            // The server is done with this connection; send the rest anew
+            if( io_release_conn(io) ) {
+                io_connect(io);
+            }
+            else {
+                io_finish(io);
+            }
+            return;
+        }
+        if( io->answered == io->sent ) {
+            io_send_start(io);
+            return;
+        }
+        io_rx_begin(io); // next pipelined response, maybe already buffered
+    }
+}
+
+/* Advances io after select() reported its socket ready, and enforces the
+ * deadlines of the current phase and of the job. */
+static void io_poll(http_io_t *io, bool ready, TickType_t now) {
+    task_args_t *job = io->job;
+
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    bool cancelled = job->cancelled;
+    xSemaphoreGive(http_job_lock);
+    if( cancelled ) {
+        ESP_LOGI(TAG, "Request cancelled");
+        TRACE_COUNT(cancels);
+        io->keep_alive = false;
+        io_finish(io);
+        return;
+    }
+
+    if( ready ) {
+        switch( io->phase ) {
+            case HTTP_PHASE_CONNECT:
+                if( 0 == conn_finish_connect(io->s, io->target->domain,
+                        io->target->port, false) ) {
+                    stats_record(NANO_REST_PHASE_CONNECT, io->phase_started);
+                    TRACE_COUNT(connects);
+                    io_send_start(io);
+                }
+                else {
+                    io_conn_failed(io, false);
+                }
+                break;
+            case HTTP_PHASE_SEND:
+                io_send(io);
+                break;
+            case HTTP_PHASE_RECV:
+                io_recv(io);
+                break;
+        }
+        if( HTTP_PHASE_DONE == io->phase ) {
+            return;
+        }
+    }
+
+    if( http_expired(io->deadline, now) ) {
+        ESP_LOGE(TAG, "HTTP Task timed out");
+        TRACE_COUNT(timeouts);
+        endpoint_report(io->target, false, 0);
+        io->keep_alive = false;
+        io_finish(io);
+    }
+    else if( http_expired(io->phase_deadline, now) ) {
+        switch( io->phase ) {
+            case HTTP_PHASE_CONNECT:
+                conn_finish_connect(io->s, io->target->domain,
+                        io->target->port, true);
+                break;
+            case HTTP_PHASE_SEND:
+                ESP_LOGE(TAG, "... timed out sending request");
+                break;
+            default:
+                ESP_LOGE(TAG, "... timed out waiting for response");
+                break;
+        }
+        TRACE_COUNT(timeouts);
+        io_conn_failed(io, true);
+    }
+}
+
+#if CONFIG_NANO_REST_HEDGE
+/* io has been waiting for its first byte for longer than most requests
+ * take: send a copy of it to the next best node. Whichever answers first
+ * wins and the other is dropped, see io_win. Returns the copy, or NULL. */
+static http_io_t *io_hedge(http_io_t *io) {
+    task_args_t *job = io->job;
+    io->hedge_armed = false;
+    http_target_t *target = endpoint_pick(io->tried);
+    if( NULL == target ) {
+        return NULL;
+    }
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    job->refs++;
+    xSemaphoreGive(http_job_lock);
+    http_io_t *hedge = io_create(job, target);
+    if( NULL == hedge ) {
+        job_release(job);
+        return NULL;
+    }
+    ESP_LOGI(TAG, "Hedging request to %s:%d", target->domain, target->port);
+    TRACE_COUNT(hedges);
+    hedge->hedge = true;
+    hedge->deadline = io->deadline;
+    hedge->started = io->started;
+    hedge->tried |= io->tried;
+    hedge->peer = io;
+    io->peer = hedge;
+    io_connect(hedge);
+    if( HTTP_PHASE_DONE == hedge->phase ) {
+        free(hedge);
+        return NULL;
+    }
+    return hedge;
+}
+#endif
+
+static http_io_t *io_start(task_args_t *job) {
+    http_io_t *io = NULL;
+    if( NULL != job->cache && NULL != job->cb ) {
+        size_t body_len;
+        char *body = cache_fetch(job->post_data, &body_len);
+        if( NULL != body ) {
+            job_deliver(job, body, body_len);
+            free(body);
+            job_finish(job);
+            return NULL;
+        }
+    }
+    TRACE_COUNT(requests);
+    if( job_set_socket(job, -1) ) {
+        http_target_t *target = endpoint_pick(0);
+        if( NULL != target ) {
+            io = io_create(job, target);
+        }
+    }
+    if( NULL == io ) {
+        TRACE_COUNT(failures);
+        job_finish(job);
+        return NULL;
+    }
+    io_connect(io);
+    return io;
+}
+
+/* Opens the loopback UDP socket pair through which other tasks wake the
+ * event loop from select(). Done on first use rather than at init, since
+ * the network stack may not be up yet then. Without it the loop polls. */
+static void http_ctrl_open(void) {
+    static bool tried = false;
+    if( tried ) {
+        return;
+    }
+    tried = true;
+
+    int ctrl = socket(AF_INET, SOCK_DGRAM, 0);
+    int wake = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if( ctrl < 0 || wake < 0 ||
+            0 != bind(ctrl, (struct sockaddr *)&addr, sizeof(addr)) ||
+            0 != getsockname(ctrl, (struct sockaddr *)&addr, &addr_len) ||
+            fcntl(ctrl, F_SETFL, fcntl(ctrl, F_GETFL, 0) | O_NONBLOCK) < 0 ) {
+        ESP_LOGW(TAG, "Unable to open control socket; polling instead");
+        if( ctrl >= 0 ) {
+            close(ctrl);
+        }
+        if( wake >= 0 ) {
+            close(wake);
+        }
+        return;
+    }
+    http_ctrl_addr = addr;
+    http_ctrl_fd = ctrl;
+    http_wake_fd = wake;
+}
+
+/* Interrupts the event loop's select() so it picks up new jobs and
+ * cancellations right away */
+static void http_wake(void) {
+    int fd = http_wake_fd;
+    if( fd >= 0 ) {
+        char c = 0;
+        sendto(fd, &c, 1, 0, (struct sockaddr *)&http_ctrl_addr,
+                sizeof(http_ctrl_addr));
+    }
+}
+
+/* The http_rest task. Every socket is non-blocking and a single select()
+ * waits for all in-flight requests at once, so one task drives up to
+ * CONFIG_NANO_REST_MAX_INFLIGHT requests, each with its own deadlines. */
+static void http_loop_task(void *arg) {
+    http_io_t *ios = NULL;
+    int n_active = 0;
+
+    for( ;; ) {
+        task_args_t *job;
+        TickType_t wait = (0 == n_active) ? portMAX_DELAY : 0;
+        while( n_active < CONFIG_NANO_REST_MAX_INFLIGHT &&
+                pdTRUE == xQueueReceive(http_request_queue, &job, wait) ) {
+            wait = 0;
+            http_ctrl_open();
+            http_io_t *io = io_start(job);
+            if( NULL == io ) {
+                continue;
+            }
+            if( HTTP_PHASE_DONE == io->phase ) {
+                free(io);
+                continue;
+            }
+            io->next = ios;
+            ios = io;
+            n_active++;
+        }
+        if( 0 == n_active ) {
+            continue;
+        }
+
+        fd_set read_fds, write_fds;
+        int max_fd = -1;
+        TickType_t now = xTaskGetTickCount();
+        TickType_t timeout = portMAX_DELAY;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        for( http_io_t *io = ios; NULL != io; io = io->next ) {
+            if( HTTP_PHASE_DONE == io->phase ) {
+                continue; // dropped hedge peer, freed below
+            }
+            FD_SET(io->s, (HTTP_PHASE_RECV == io->phase) ? &read_fds : &write_fds);
+            if( io->s > max_fd ) {
+                max_fd = io->s;
+            }
+            TickType_t deadline = io->phase_deadline;
+            if( http_expired(io->deadline, deadline) ) {
+                deadline = io->deadline;
+            }
+            if( io->hedge_armed && http_expired(io->hedge_at, deadline) ) {
+                deadline = io->hedge_at;
+            }
+            TickType_t left = http_expired(deadline, now) ? 0 : deadline - now;
+            if( left < timeout ) {
+                timeout = left;
+            }
+        }
+        if( http_ctrl_fd >= 0 ) {
+            FD_SET(http_ctrl_fd, &read_fds);
+            if( http_ctrl_fd > max_fd ) {
+                max_fd = http_ctrl_fd;
+            }
+        }
+        else if( n_active < CONFIG_NANO_REST_MAX_INFLIGHT &&
+                timeout > pdMS_TO_TICKS(HTTP_POLL_INTERVAL_MS) ) {
+            timeout = pdMS_TO_TICKS(HTTP_POLL_INTERVAL_MS);
+        }
+        uint32_t timeout_ms = timeout * portTICK_PERIOD_MS;
+        struct timeval tv = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        int ret = select(max_fd + 1, &read_fds, &write_fds, NULL, &tv);
+        if( ret < 0 ) {
+            if( EINTR != errno ) {
+                ESP_LOGE(TAG, "select failed errno=%d", errno);
+                vTaskDelay(1);
+            }
+            FD_ZERO(&read_fds);
+            FD_ZERO(&write_fds);
+        }
+        if( http_ctrl_fd >= 0 && FD_ISSET(http_ctrl_fd, &read_fds) ) {
+            char buf[16];
+            while( recv(http_ctrl_fd, buf, sizeof(buf), 0) > 0 ) {
+            }
+        }
+
+        now = xTaskGetTickCount();
+        http_io_t *hedges = NULL;
+        for( http_io_t **p = &ios; NULL != *p; ) {
+            http_io_t *io = *p;
+            if( HTTP_PHASE_DONE != io->phase ) {
+                bool ready = FD_ISSET(io->s,
+                        (HTTP_PHASE_RECV == io->phase) ? &read_fds : &write_fds);
+                io_poll(io, ready, now);
+            }
+#if CONFIG_NANO_REST_HEDGE
+            if( HTTP_PHASE_DONE != io->phase && io->hedge_armed &&
+                    http_expired(io->hedge_at, now) &&
+                    n_active < CONFIG_NANO_REST_MAX_INFLIGHT ) {
+                http_io_t *hedge = io_hedge(io);
+                if( NULL != hedge ) {
+                    hedge->next = hedges;
+                    hedges = hedge;
+                    n_active++;
+                }
+            }
+#endif
+            if( HTTP_PHASE_DONE == io->phase ) {
+                *p = io->next;
+                free(io);
+                n_active--;
+            }
+            else {
+                p = &io->next;
+            }
+        }
+        while( NULL != hedges ) {
+            http_io_t *hedge = hedges;
+            hedges = hedge->next;
+            hedge->next = ios;
+            ios = hedge;
+        }
+    }
+}
+
+/* Creates the locks, the request queue and the http_rest task on first
+ * use. Safe to call from several tasks at once. */
+static bool http_init(void) {
+    portENTER_CRITICAL(&http_init_mux);
+    uint8_t state = http_init_state;
+    if( 0 == state ) {
+        http_init_state = 1;
+    }
+    portEXIT_CRITICAL(&http_init_mux);
+    if( 2 == state ) {
+        return true;
+    }
+    if( 1 == state ) {
+        // Another task is starting up; wait for it to finish or give up
+        while( 1 == http_init_state ) {
+            vTaskDelay(1);
+        }
+        return 2 == http_init_state;
+    }
+
+    ESP_LOGI(TAG, "Starting http_rest task");
+    if( NULL == http_job_lock ) {
+        http_job_lock = xSemaphoreCreateMutex();
+    }
+    if( NULL == http_state_lock ) {
+        http_state_lock = xSemaphoreCreateMutex();
+    }
+    if( NULL == http_request_queue ) {
+        http_request_queue = xQueueCreate(CONFIG_NANO_REST_QUEUE_LENGTH,
+                sizeof(task_args_t *));
+    }
+    if( NULL == http_job_lock || NULL == http_state_lock ||
+            NULL == http_request_queue || !cache_init() ) {
+        ESP_LOGE(TAG, "Unable to allocate http_rest resources");
+        http_init_state = 0;
+        return false;
+    }
+    if( pdPASS != xTaskCreate(http_loop_task,
+            "http_rest", CONFIG_NANO_REST_TASK_STACK_SIZE,
+            NULL, CONFIG_NANO_REST_TASK_PRIORITY, NULL) ) {
+        ESP_LOGE(TAG, "Unable to create http_rest task");
+        http_init_state = 0;
+        return false;
+    }
+    http_init_state = 2;
+    return true;
+}
+
+/* Queues a blocking request and waits for it, cancelling it on timeout.
+ * Consumes the caller's reference to job. */
+static int job_run(task_args_t *job) {
+    int res = -1;
+    TickType_t timeout = pdMS_TO_TICKS(CONFIG_NANO_REST_RECEIVE_TIMEOUT * 1000);
+    TickType_t start = xTaskGetTickCount();
+    if( pdTRUE != xQueueSend(http_request_queue, &job, timeout) ) {
+        ESP_LOGE(TAG, "HTTP request queue full");
+        job_release(job); // never reaches the event loop
+        job_release(job);
+        return -1;
+    }
+    http_wake();
+    TickType_t waited = xTaskGetTickCount() - start;
+    if( xSemaphoreTake( job->complete,
+            waited < timeout ? timeout - waited : 0) ) {
+        res = job->result;
+    }
+    else {
+        /* Timed out; the event loop drops the request at its next checkpoint.
+         * If it is mid-exchange it may be writing into the caller's buffer
+         * or calling back into it, so wake it up and wait for it to let go. */
+        xSemaphoreTake(http_job_lock, portMAX_DELAY);
+        bool busy = job->s >= 0;
+        job_cancel_locked(job);
+        xSemaphoreGive(http_job_lock);
+        if( busy ) {
+            xSemaphoreTake(job->complete, portMAX_DELAY);
+        }
+        ESP_LOGE(TAG, "HTTP Task timed out");
+    }
+    job_release(job);
+    return res;
+}
+
+static int http_get_data(char *post_data, char *result_data_buf,
+        size_t result_data_buf_len, bool use_cache) {
+    if( 0 == result_data_buf_len ) {
+        return -1;
+    }
+    result_data_buf[0] = '\0';
+    if( !http_init() ) {
+        return -1;
+    }
+    if( use_cache && NULL != post_data &&
+            cache_lookup(post_data, result_data_buf, result_data_buf_len) ) {
+        return 0;
+    }
+    task_args_t *job = job_create(1, &post_data, 1,
+            result_data_buf, result_data_buf_len, NULL, NULL);
+    if( NULL == job ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return -1;
+    }
+    int res = job_run(job);
+    if( 0 != res ) {
+        result_data_buf[0] = '\0';
+    }
+    return res;
+}
+
+int network_get_data(char *post_data,
+        char *result_data_buf, size_t result_data_buf_len){
+    return http_get_data(post_data, result_data_buf, result_data_buf_len,
+            true);
+}
+
+int nano_rest_post_fresh(char *post_data,
+        char *result_data_buf, size_t result_data_buf_len) {
+    return http_get_data(post_data, result_data_buf, result_data_buf_len,
+            false);
+}
+
+int http_rpc(rpc_id_t rpc, const char *const *args,
+        char *result_data_buf, size_t result_data_buf_len) {
+    if( 0 == result_data_buf_len ) {
+        return -1;
+    }
+    result_data_buf[0] = '\0';
+    size_t arg_lens[RPC_MAX_ARGS];
+    size_t post_len = rpc_length(rpc, args, arg_lens);
+    if( 0 == post_len || !http_init() ) {
+        return -1;
+    }
+    size_t action_len = 0;
+    const char *action = rpc_action(rpc, &action_len);
+    // The cache is asked before anything is allocated, so a hit stays
+    // cheap. Cached RPCs take an account or a hash and fit key.
+    char key[HTTP_RPC_KEY_SIZE];
+    bool keyed = NULL != cache_policy(action, action_len) &&
+            post_len < sizeof(key);
+    if( keyed ) {
+        rpc_write(rpc, args, arg_lens, key);
+        key[post_len] = '\0';
+        if( cache_lookup(key, result_data_buf, result_data_buf_len) ) {
+            return 0;
+        }
+    }
+    task_args_t *job = job_alloc(post_len + 2, result_data_buf,
+            result_data_buf_len, NULL, NULL);
+    if( NULL == job ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return -1;
+    }
+    // The one request body of the job
+    if( keyed ) {
+        memcpy(job->post_data, key, post_len);
+    }
+    else {
+        rpc_write(rpc, args, arg_lens, job->post_data);
+    }
+    job->post_data[post_len] = '\0';
+    job->post_data[post_len + 1] = '\0';
+    job->post_len = post_len;
+    job_classify(job, action, action_len, 1);
+    job_register(job, 1);
+    int res = job_run(job);
+    if( 0 != res ) {
+        result_data_buf[0] = '\0';
+    }
+    return res;
+}
+
+int nano_rest_post_stream(char *post_data,
+        nano_rest_chunk_cb_t on_body_chunk, void *ctx) {
+    if( NULL == on_body_chunk || !http_init() ) {
+        return -1;
+    }
+    task_args_t *job = job_create(1, &post_data, 1, NULL, 0, NULL, NULL);
+    if( NULL == job ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return -1;
+    }
+    job->on_chunk = on_body_chunk;
+    job->chunk_ctx = ctx;
+    return job_run(job);
+}
+
+int nano_rest_post_batch(nano_rest_batch_item_t *items, size_t n) {
+    if( NULL == items || 0 == n ) {
+        return -1;
+    }
+    for( size_t i = 0; i < n; i++ ) {
+        if( 0 == items[i].result_data_buf_len ) {
+            return -1;
+        }
+        items[i].result_data_buf[0] = '\0';
+        items[i].status = -1;
+    }
+    if( !http_init() ) {
+        return -1;
+    }
+    char **post_data = malloc(n * sizeof(char *));
+    if( NULL == post_data ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return -1;
+    }
+    for( size_t i = 0; i < n; i++ ) {
+        post_data[i] = items[i].post_data;
+    }
+    task_args_t *job = job_create(1, post_data, n, NULL, 0, NULL, NULL);
+    free(post_data);
+    if( NULL == job ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return -1;
+    }
+    job->batch = items;
+    job->batch_len = n;
+    int res = job_run(job);
+    for( size_t i = 0; i < n; i++ ) {
+        if( 0 != items[i].status ) {
+            items[i].result_data_buf[0] = '\0';
+        }
+    }
+    return res;
+}
+
+nano_rest_handle_t nano_rest_post_async(char *post_data,
+        nano_rest_cb_t cb, void *ctx) {
+    if( NULL == cb || !http_init() ) {
+        return 0;
+    }
+    task_args_t *job = job_create(1, &post_data, 1, NULL, 0, cb, ctx);
+    if( NULL == job ) {
+        ESP_LOGE(TAG, "Unable to allocate request");
+        return 0;
+    }
+    nano_rest_handle_t id = job->id;
+    if( pdTRUE != xQueueSend(http_request_queue, &job, 0) ) {
+        ESP_LOGE(TAG, "HTTP request queue full");
+        job_release(job);
+        return 0;
+    }
+    http_wake();
+    return id;
+}
+
+void nano_rest_cancel(nano_rest_handle_t handle) {
+    if( 0 == handle || NULL == http_job_lock ) {
+        return;
+    }
+    xSemaphoreTake(http_job_lock, portMAX_DELAY);
+    for( task_args_t *job = http_jobs; NULL != job; job = job->next ) {
+        if( job->id == handle ) {
+            job_cancel_locked(job);
+            break;
+        }
+    }
+    xSemaphoreGive(http_job_lock);
 }
@@ -0,0 +1,304 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* LRU cache of responses to read-only RPCs. Entries are found by a hash of
+ * the request body, live for the TTL of their action and are evicted least
+ * recently used first once CONFIG_NANO_REST_CACHE_SIZE bytes are taken.
+ * RPCs that publish a block drop the entries describing account state, and
+ * bump a generation so that responses already in flight are not stored. */
+
+#include "sdkconfig.h"
+#define LOG_LOCAL_LEVEL CONFIG_NANO_REST_LOG_LEVEL
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "nano_rest.h"
+#include "nano_rest_cache.h"
+
+#if CONFIG_NANO_REST_CACHE
+
+#include "esp_timer.h"
+
+static const char *TAG = "network_rest";
+
+/* Reuse period of the responses to each read-only RPC */
+static const cache_policy_t cache_policies[] = {
+    { "account_balance",         5000, true },
+    { "account_block_count",     5000, true },
+    { "account_info",            5000, true },
+    { "account_key",          3600000, false },
+    { "account_representative",  5000, true },
+    { "account_weight",         30000, false },
+    { "accounts_balances",       5000, true },
+    { "accounts_frontiers",      5000, true },
+    { "accounts_pending",        5000, true },
+    { "active_difficulty",       2000, false },
+    { "available_supply",       60000, false },
+    { "block_account",        3600000, false },
+    { "block_count",             5000, true },
+    { "block_info",             10000, true },
+    { "blocks",               3600000, false },
+    { "blocks_info",            10000, true },
+    { "frontier_count",          5000, true },
+    { "pending",                 5000, true },
+    { "pending_exists",          5000, true },
+    { "representatives",        60000, false },
+    { "representatives_online", 60000, false },
+    { "version",              3600000, false },
+};
+
+/* RPCs that publish a block */
+static const char *const cache_write_actions[] = {
+    "account_representative_set", "process", "receive", "receive_all",
+    "send",
+};
+
+#define CACHE_ENTRY_MAX_SIZE (CONFIG_NANO_REST_CACHE_SIZE / 4)
+
+typedef struct cache_entry_t {
+    struct cache_entry_t *prev; // more recently used
+    struct cache_entry_t *next;
+    uint32_t hash;
+    bool account_state;
+    int64_t expires_us;
+    size_t key_len;
+    size_t body_len;
+    char data[]; // key, then NUL-terminated body
+} cache_entry_t;
+
+static SemaphoreHandle_t cache_lock = NULL;
+// Protected by cache_lock
+static cache_entry_t *cache_head = NULL; // most recently used
+static cache_entry_t *cache_tail = NULL;
+static size_t cache_used = 0;
+static uint32_t cache_gen = 0;
+
+static bool cache_action_is(const char *name, const char *action,
+        size_t action_len) {
+    return strlen(name) == action_len && 0 == strncmp(name, action, action_len);
+}
+
+const cache_policy_t *cache_policy(const char *action, size_t action_len) {
+    for( size_t i = 0; i < sizeof(cache_policies) / sizeof(cache_policies[0]);
+            i++ ) {
+        if( cache_action_is(cache_policies[i].action, action, action_len) ) {
+            return &cache_policies[i];
+        }
+    }
+    return NULL;
+}
+
+bool cache_action_writes(const char *action, size_t action_len) {
+    for( size_t i = 0; i < sizeof(cache_write_actions) /
+            sizeof(cache_write_actions[0]); i++ ) {
+        if( cache_action_is(cache_write_actions[i], action, action_len) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* FNV-1a */
+static uint32_t cache_hash(const char *key, size_t len) {
+    uint32_t h = 2166136261u;
+    for( size_t i = 0; i < len; i++ ) {
+        h = (h ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static size_t cache_entry_size(const cache_entry_t *e) {
+    return sizeof(cache_entry_t) + e->key_len + e->body_len + 1;
+}
+
+static void cache_unlink(cache_entry_t *e) {
+    if( e->prev ) {
+        e->prev->next = e->next;
+    }
+    else {
+        cache_head = e->next;
+    }
+    if( e->next ) {
+        e->next->prev = e->prev;
+    }
+    else {
+        cache_tail = e->prev;
+    }
+}
+
+static void cache_push_front(cache_entry_t *e) {
+    e->prev = NULL;
+    e->next = cache_head;
+    if( cache_head ) {
+        cache_head->prev = e;
+    }
+    else {
+        cache_tail = e;
+    }
+    cache_head = e;
+}
+
+static void cache_remove(cache_entry_t *e) {
+    cache_unlink(e);
+    cache_used -= cache_entry_size(e);
+    free(e);
+}
+
+/* Fresh entry for key, moved to the front; expired ones are dropped on the
+ * way. Called with cache_lock held. */
+static cache_entry_t *cache_find(const char *key, size_t key_len,
+        uint32_t hash) {
+    int64_t now = esp_timer_get_time();
+    for( cache_entry_t *e = cache_head, *next; NULL != e; e = next ) {
+        next = e->next;
+        if( now >= e->expires_us ) {
+            cache_remove(e);
+        }
+        else if( e->hash == hash && e->key_len == key_len &&
+                0 == memcmp(e->data, key, key_len) ) {
+            cache_unlink(e);
+            cache_push_front(e);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+bool cache_init(void) {
+    if( NULL == cache_lock ) {
+        cache_lock = xSemaphoreCreateMutex();
+    }
+    return NULL != cache_lock;
+}
+
+uint32_t cache_generation(void) {
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    uint32_t gen = cache_gen;
+    xSemaphoreGive(cache_lock);
+    return gen;
+}
+
+bool cache_lookup(const char *post_data, char *buf, size_t buf_len) {
+    size_t key_len = strlen(post_data);
+    uint32_t hash = cache_hash(post_data, key_len);
+    bool hit = false;
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    cache_entry_t *e = cache_find(post_data, key_len, hash);
+    if( NULL != e && e->body_len < buf_len ) {
+        memcpy(buf, &e->data[e->key_len], e->body_len + 1);
+        hit = true;
+    }
+    xSemaphoreGive(cache_lock);
+    if( hit ) {
+        ESP_LOGD(TAG, "Cache hit");
+    }
+    return hit;
+}
+
+char *cache_fetch(const char *post_data, size_t *body_len) {
+    size_t key_len = strlen(post_data);
+    uint32_t hash = cache_hash(post_data, key_len);
+    char *body = NULL;
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    cache_entry_t *e = cache_find(post_data, key_len, hash);
+    if( NULL != e ) {
+        body = malloc(e->body_len + 1);
+        if( NULL != body ) {
+            memcpy(body, &e->data[e->key_len], e->body_len + 1);
+            *body_len = e->body_len;
+        }
+    }
+    xSemaphoreGive(cache_lock);
+    if( NULL != body ) {
+        ESP_LOGD(TAG, "Cache hit");
+    }
+    return body;
+}
+
+void cache_store(const char *post_data, const cache_policy_t *policy,
+        uint32_t gen, int status, const char *body, size_t body_len) {
+    if( status < 200 || status > 299 ) {
+        return;
+    }
+    // The node answers errors with 200 too; don't hold on to them
+    const char *p = body;
+    while( '{' == *p || ' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p ) {
+        p++;
+    }
+    if( 0 == strncmp(p, "\"error\"", 7) ) {
+        return;
+    }
+    size_t key_len = strlen(post_data);
+    size_t size = sizeof(cache_entry_t) + key_len + body_len + 1;
+    if( size > CACHE_ENTRY_MAX_SIZE ) {
+        return;
+    }
+    cache_entry_t *e = malloc(size);
+    if( NULL == e ) {
+        return;
+    }
+    e->hash = cache_hash(post_data, key_len);
+    e->account_state = policy->account_state;
+    e->expires_us = esp_timer_get_time() + (int64_t)policy->ttl_ms * 1000;
+    e->key_len = key_len;
+    e->body_len = body_len;
+    memcpy(e->data, post_data, key_len);
+    memcpy(&e->data[key_len], body, body_len);
+    e->data[key_len + body_len] = '\0';
+
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    if( gen != cache_gen ) {
+        // A block was published while this was in flight
+        xSemaphoreGive(cache_lock);
+        free(e);
+        return;
+    }
+    cache_entry_t *old = cache_find(post_data, key_len, e->hash);
+    if( NULL != old ) {
+        cache_remove(old);
+    }
+    while( NULL != cache_tail && cache_used + size > CONFIG_NANO_REST_CACHE_SIZE ) {
+        cache_remove(cache_tail);
+    }
+    cache_push_front(e);
+    cache_used += size;
+    xSemaphoreGive(cache_lock);
+}
+
+void cache_invalidate(void) {
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    cache_gen++;
+    for( cache_entry_t *e = cache_head, *next; NULL != e; e = next ) {
+        next = e->next;
+        if( e->account_state ) {
+            cache_remove(e);
+        }
+    }
+    xSemaphoreGive(cache_lock);
+}
+
+void nano_rest_cache_flush(void) {
+    if( NULL == cache_lock ) {
+        return;
+    }
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    cache_gen++;
+    while( NULL != cache_head ) {
+        cache_remove(cache_head);
+    }
+    xSemaphoreGive(cache_lock);
+}
+
+#else
+
+void nano_rest_cache_flush(void) {
+}
+
+#endif
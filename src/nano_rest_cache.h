@@ -0,0 +1,83 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Response cache for read-only RPCs, keyed by the request body */
+
+#ifndef __NANO_REST_CACHE_H__
+#define __NANO_REST_CACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/* How long the response to an action may be reused */
+typedef struct cache_policy_t {
+    const char *action;
+    uint32_t ttl_ms;
+    bool account_state; // stale once a block has been published
+} cache_policy_t;
+
+#if CONFIG_NANO_REST_CACHE
+
+bool cache_init(void);
+/* Caching policy of the RPC action, NULL if its responses are not cached */
+const cache_policy_t *cache_policy(const char *action, size_t action_len);
+/* Whether the RPC action publishes a block, see cache_invalidate */
+bool cache_action_writes(const char *action, size_t action_len);
+/* Current generation, to be passed to cache_store once the response is in */
+uint32_t cache_generation(void);
+/* Copies a fresh response to post_data into buf. Returns false on a miss,
+ * including if it does not fit. */
+bool cache_lookup(const char *post_data, char *buf, size_t buf_len);
+/* Like cache_lookup, but returns a copy the caller frees, or NULL */
+char *cache_fetch(const char *post_data, size_t *body_len);
+/* Remembers body, sent with HTTP status, as the response to post_data.
+ * Only successful responses are kept, and none if the cache has been
+ * invalidated since generation gen. */
+void cache_store(const char *post_data, const cache_policy_t *policy,
+        uint32_t gen, int status, const char *body, size_t body_len);
+/* Drops the responses describing account state */
+void cache_invalidate(void);
+
+#else
+
+static inline bool cache_init(void) {
+    return true;
+}
+
+static inline const cache_policy_t *cache_policy(const char *action,
+        size_t action_len) {
+    return NULL;
+}
+
+static inline bool cache_action_writes(const char *action, size_t action_len) {
+    return false;
+}
+
+static inline uint32_t cache_generation(void) {
+    return 0;
+}
+
+static inline bool cache_lookup(const char *post_data, char *buf,
+        size_t buf_len) {
+    return false;
+}
+
+static inline char *cache_fetch(const char *post_data, size_t *body_len) {
+    return NULL;
+}
+
+static inline void cache_store(const char *post_data,
+        const cache_policy_t *policy, uint32_t gen, int status,
+        const char *body, size_t body_len) {
+}
+
+static inline void cache_invalidate(void) {
+}
+
+#endif
+
+#endif
@@ -0,0 +1,506 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Extracts registered fields from a JSON response as its bytes come off
+ * the socket, one character at a time and without buffering the document
+ * or touching the heap. Each open container keeps a bitmask of the fields
+ * whose path leads into it; a field takes every scalar its full path
+ * matches. */
+
+#include "sdkconfig.h"
+#define LOG_LOCAL_LEVEL CONFIG_NANO_REST_LOG_LEVEL
+
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "nano_rest.h"
+#include "nano_rest_json.h"
+
+static const char *TAG = "network_rest";
+
+enum {
+    JSON_VALUE = 0,     // a value
+    JSON_VALUE_OR_END,  // the first element of an array, or ]
+    JSON_KEY_OR_END,    // the first member of an object, or }
+    JSON_KEY,           // a member name
+    JSON_COLON,
+    JSON_STRING,        // inside a member name or string value
+    JSON_ESCAPE,        // after a backslash
+    JSON_UNICODE,       // the hex digits of \u
+    JSON_LITERAL,       // a number, true, false or null
+    JSON_AFTER_VALUE,   // , or the end of the container
+    JSON_DONE,
+};
+
+static bool json_is_ws(char c) {
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+/* Segment d of a dotted path, of *len characters, or NULL if the path is
+ * shorter */
+static const char *json_segment(const char *path, unsigned d, size_t *len) {
+    for( ; d > 0; d-- ) {
+        path = strchr(path, '.');
+        if( NULL == path ) {
+            return NULL;
+        }
+        path++;
+    }
+    const char *end = strchr(path, '.');
+    *len = (NULL == end) ? strlen(path) : (size_t)(end - path);
+    return path;
+}
+
+static size_t json_field_max(const nano_rest_json_field_t *f) {
+    return (f->max > 0) ? f->max : 1;
+}
+
+/* Works out which fields want the member named key (or the next array
+ * element) of the innermost container */
+static void json_child(json_parser_t *p, bool element) {
+    p->next = p->term = 0;
+    if( p->depth > JSON_MAX_DEPTH ) {
+        return;
+    }
+    uint32_t m = p->mask[p->depth];
+    for( unsigned i = 0; i < p->n_fields; i++ ) {
+        if( !(m & (1u << i)) ) {
+            continue;
+        }
+        nano_rest_json_field_t *f = &p->fields[i];
+        size_t len = 0;
+        const char *seg = json_segment(f->path, p->depth - 1, &len);
+        bool any = (1 == len && '*' == seg[0]);
+        if( !any && (element || len != p->key_len || len > JSON_KEY_MAX ||
+                0 != memcmp(seg, p->key, len)) ) {
+            continue;
+        }
+        if( NULL != json_segment(f->path, p->depth, &len) ) {
+            p->next |= 1u << i;
+        }
+        else if( NANO_REST_JSON_KEY != f->type ) {
+            p->term |= 1u << i;
+        }
+        else if( !element ) {
+            if( f->count >= json_field_max(f) || p->key_len >= f->size ||
+                    p->key_len > JSON_KEY_MAX ) {
+                ESP_LOGE(TAG, "No room for %s", f->path);
+                p->full = true;
+                continue;
+            }
+            char *dst = (char *)f->dst + f->count * f->size;
+            memcpy(dst, p->key, p->key_len);
+            dst[p->key_len] = '\0';
+            f->count++;
+        }
+    }
+}
+
+static void json_put(json_parser_t *p, char c) {
+    if( p->in_key ) {
+        if( p->key_len < JSON_KEY_MAX ) {
+            p->key[p->key_len] = c;
+        }
+        p->key_len++; // too long to ever match once past JSON_KEY_MAX
+        return;
+    }
+    if( p->value_len < sizeof(p->scratch) - 1 ) {
+        p->scratch[p->value_len] = c;
+    }
+    for( unsigned i = 0; i < p->n_fields && p->quoted; i++ ) {
+        nano_rest_json_field_t *f = &p->fields[i];
+        if( (p->term & (1u << i)) && NANO_REST_JSON_STRING == f->type &&
+                f->count < json_field_max(f) && p->value_len + 1 < f->size ) {
+            ((char *)f->dst)[f->count * f->size + p->value_len] = c;
+        }
+    }
+    p->value_len++;
+}
+
+/* Parses the decimal in the scratch buffer, quoted or not as Nano nodes
+ * vary */
+static bool json_scratch_uint64(const json_parser_t *p, uint64_t *v) {
+    if( 0 == p->value_len || p->value_len >= sizeof(p->scratch) ) {
+        return false;
+    }
+    *v = 0;
+    for( size_t i = 0; i < p->value_len; i++ ) {
+        char c = p->scratch[i];
+        if( c < '0' || c > '9' || *v > (UINT64_MAX - (c - '0')) / 10 ) {
+            return false;
+        }
+        *v = *v * 10 + (c - '0');
+    }
+    return true;
+}
+
+static bool json_scratch_is(const json_parser_t *p, const char *literal) {
+    return strlen(literal) == p->value_len &&
+            0 == memcmp(p->scratch, literal, p->value_len);
+}
+
+/* Hands the scalar just parsed to the fields that take it */
+static void json_value_end(json_parser_t *p) {
+    bool null = !p->quoted && json_scratch_is(p, "null");
+    for( unsigned i = 0; i < p->n_fields && !null; i++ ) {
+        if( !(p->term & (1u << i)) ) {
+            continue;
+        }
+        nano_rest_json_field_t *f = &p->fields[i];
+        if( f->count >= json_field_max(f) ) {
+            ESP_LOGE(TAG, "No room for %s", f->path);
+            p->full = true;
+            continue;
+        }
+        uint64_t u;
+        switch( f->type ) {
+            case NANO_REST_JSON_STRING:
+                if( !p->quoted ) {
+                    break; // a number, true or false
+                }
+                if( p->value_len >= f->size ) {
+                    ESP_LOGE(TAG, "No room for %s", f->path);
+                    p->full = true;
+                    break;
+                }
+                ((char *)f->dst)[f->count * f->size + p->value_len] = '\0';
+                f->count++;
+                break;
+            case NANO_REST_JSON_UINT64:
+                if( json_scratch_uint64(p, &u) ) {
+                    ((uint64_t *)f->dst)[f->count++] = u;
+                }
+                break;
+            case NANO_REST_JSON_BOOL:
+                if( json_scratch_is(p, "true") || json_scratch_is(p, "false") ) {
+                    ((bool *)f->dst)[f->count++] = ('t' == p->scratch[0]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    p->state = (p->depth > 0) ? JSON_AFTER_VALUE : JSON_DONE;
+}
+
+static void json_open(json_parser_t *p, bool array) {
+    if( p->depth >= 32 ) {
+        p->error = true;
+        return;
+    }
+    p->depth++;
+    if( p->depth <= JSON_MAX_DEPTH ) {
+        p->mask[p->depth] = p->next;
+    }
+    if( array ) {
+        p->arrays |= 1u << (p->depth - 1);
+        p->state = JSON_VALUE_OR_END;
+        json_child(p, true);
+    }
+    else {
+        p->arrays &= ~(1u << (p->depth - 1));
+        p->state = JSON_KEY_OR_END;
+    }
+}
+
+static void json_close(json_parser_t *p, char c) {
+    bool array = p->arrays & (1u << (p->depth - 1));
+    if( array != (']' == c) ) {
+        p->error = true;
+        return;
+    }
+    p->depth--;
+    p->state = (p->depth > 0) ? JSON_AFTER_VALUE : JSON_DONE;
+}
+
+static void json_value_begin(json_parser_t *p, char c) {
+    if( '{' == c || '[' == c ) {
+        json_open(p, '[' == c);
+        return;
+    }
+    p->value_len = 0;
+    if( '"' == c ) {
+        p->quoted = true;
+        p->state = JSON_STRING;
+    }
+    else if( '-' == c || (c >= '0' && c <= '9') || 't' == c || 'f' == c ||
+            'n' == c ) {
+        p->quoted = false;
+        p->state = JSON_LITERAL;
+        json_put(p, c);
+    }
+    else {
+        p->error = true;
+    }
+}
+
+static void json_char(json_parser_t *p, char c) {
+    switch( p->state ) {
+        case JSON_VALUE_OR_END:
+            if( ']' == c ) {
+                json_close(p, c);
+                return;
+            }
+            // fall through
+        case JSON_VALUE:
+            if( !json_is_ws(c) ) {
+                json_value_begin(p, c);
+            }
+            return;
+        case JSON_KEY_OR_END:
+            if( '}' == c ) {
+                json_close(p, c);
+                return;
+            }
+            // fall through
+        case JSON_KEY:
+            if( '"' == c ) {
+                p->in_key = true;
+                p->key_len = 0;
+                p->state = JSON_STRING;
+            }
+            else if( !json_is_ws(c) ) {
+                p->error = true;
+            }
+            return;
+        case JSON_COLON:
+            if( ':' == c ) {
+                json_child(p, false);
+                p->state = JSON_VALUE;
+            }
+            else if( !json_is_ws(c) ) {
+                p->error = true;
+            }
+            return;
+        case JSON_STRING:
+            if( '"' == c ) {
+                if( p->in_key ) {
+                    p->in_key = false;
+                    p->state = JSON_COLON;
+                }
+                else {
+                    json_value_end(p);
+                }
+            }
+            else if( '\\' == c ) {
+                p->state = JSON_ESCAPE;
+            }
+            else if( (unsigned char)c < 0x20 ) {
+                p->error = true;
+            }
+            else {
+                json_put(p, c);
+            }
+            return;
+        case JSON_ESCAPE:
+            p->state = JSON_STRING;
+            switch( c ) {
+                case '"': case '\\': case '/':
+                    json_put(p, c);
+                    break;
+                case 'b': json_put(p, '\b'); break;
+                case 'f': json_put(p, '\f'); break;
+                case 'n': json_put(p, '\n'); break;
+                case 'r': json_put(p, '\r'); break;
+                case 't': json_put(p, '\t'); break;
+                case 'u':
+                    // Nano RPC values are ASCII; stand in for anything else
+                    json_put(p, '?');
+                    p->unicode_left = 4;
+                    p->state = JSON_UNICODE;
+                    break;
+                default:
+                    p->error = true;
+                    break;
+            }
+            return;
+        case JSON_UNICODE:
+            if( !((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+                    (c >= 'A' && c <= 'F')) ) {
+                p->error = true;
+            }
+            else if( 0 == --p->unicode_left ) {
+                p->state = JSON_STRING;
+            }
+            return;
+        case JSON_LITERAL:
+            if( (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                    (c >= 'A' && c <= 'Z') || '-' == c || '+' == c || '.' == c ) {
+                json_put(p, c);
+                return;
+            }
+            json_value_end(p);
+            json_char(p, c); // the delimiter
+            return;
+        case JSON_AFTER_VALUE:
+            if( ',' == c ) {
+                if( p->arrays & (1u << (p->depth - 1)) ) {
+                    json_child(p, true);
+                    p->state = JSON_VALUE;
+                }
+                else {
+                    p->state = JSON_KEY;
+                }
+            }
+            else if( '}' == c || ']' == c ) {
+                json_close(p, c);
+            }
+            else if( !json_is_ws(c) ) {
+                p->error = true;
+            }
+            return;
+        case JSON_DONE:
+            if( !json_is_ws(c) ) {
+                p->error = true;
+            }
+            return;
+    }
+}
+
+void json_begin(json_parser_t *p, nano_rest_json_field_t *fields,
+        size_t n_fields) {
+    memset(p, 0, sizeof(json_parser_t));
+    p->fields = fields;
+    p->n_fields = n_fields;
+    p->state = JSON_VALUE;
+    // Every path leads into the document itself
+    p->next = (n_fields < 32) ? (1u << n_fields) - 1 : UINT32_MAX;
+    for( size_t i = 0; i < n_fields; i++ ) {
+        fields[i].count = 0;
+    }
+}
+
+void json_feed(json_parser_t *p, const char *data, size_t len) {
+    for( size_t i = 0; i < len && !p->error; i++ ) {
+        json_char(p, data[i]);
+    }
+}
+
+int json_end(json_parser_t *p) {
+    if( JSON_LITERAL == p->state && 0 == p->depth ) {
+        json_value_end(p); // a bare number runs up to the end
+    }
+    if( p->error || JSON_DONE != p->state ) {
+        ESP_LOGE(TAG, "Malformed JSON response");
+        return -1;
+    }
+    return p->full ? -1 : 0;
+}
+
+/* Minimal scanning of a document held in memory, just enough to cut
+ * members out of it */
+static const char *json_skip_ws(const char *p) {
+    while( json_is_ws(*p) ) {
+        p++;
+    }
+    return p;
+}
+
+static const char *json_skip_string(const char *p) {
+    for( p++; '"' != *p; p++ ) {
+        if( '\0' == *p ) {
+            return NULL;
+        }
+        if( '\\' == *p && '\0' == *++p ) {
+            return NULL;
+        }
+    }
+    return p + 1;
+}
+
+/* Returns the end of the value starting at p, or NULL if malformed */
+static const char *json_skip_value(const char *p) {
+    if( '"' == *p ) {
+        return json_skip_string(p);
+    }
+    if( '{' != *p && '[' != *p ) {
+        // number, true, false or null
+        while( '\0' != *p && ',' != *p && '}' != *p && ']' != *p &&
+                ' ' != *p && '\r' != *p && '\n' != *p && '\t' != *p ) {
+            p++;
+        }
+        return p;
+    }
+    int depth = 0;
+    for( ;; ) {
+        switch( *p ) {
+            case '\0':
+                return NULL;
+            case '"':
+                p = json_skip_string(p);
+                if( NULL == p ) {
+                    return NULL;
+                }
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if( 0 == --depth ) {
+                    return p + 1;
+                }
+                break;
+        }
+        p++;
+    }
+}
+
+const char *json_find_member(const char *obj, const char *name,
+        const char **end) {
+    size_t name_len = strlen(name);
+    const char *p = json_skip_ws(obj);
+    if( '{' != *p ) {
+        return NULL;
+    }
+    p = json_skip_ws(p + 1);
+    while( '"' == *p ) {
+        const char *key = p + 1;
+        p = json_skip_string(p);
+        if( NULL == p ) {
+            return NULL;
+        }
+        bool match = (size_t)(p - 1 - key) == name_len &&
+                0 == strncmp(key, name, name_len);
+        p = json_skip_ws(p);
+        if( ':' != *p ) {
+            return NULL;
+        }
+        const char *value = json_skip_ws(p + 1);
+        p = json_skip_value(value);
+        if( NULL == p ) {
+            return NULL;
+        }
+        if( match ) {
+            *end = p;
+            return value;
+        }
+        p = json_skip_ws(p);
+        if( ',' != *p ) {
+            return NULL;
+        }
+        p = json_skip_ws(p + 1);
+    }
+    return NULL;
+}
+
+static void json_on_chunk(const char *data, size_t len, void *ctx) {
+    json_feed((json_parser_t *)ctx, data, len);
+}
+
+int nano_rest_post_extract(char *post_data, nano_rest_json_field_t *fields,
+        size_t n_fields) {
+    if( NULL == fields || n_fields > JSON_MAX_FIELDS ) {
+        return -1;
+    }
+    json_parser_t parser;
+    json_begin(&parser, fields, n_fields);
+    if( 0 != nano_rest_post_stream(post_data, json_on_chunk, &parser) ) {
+        return -1;
+    }
+    return json_end(&parser);
+}
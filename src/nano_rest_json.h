@@ -0,0 +1,57 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Streaming JSON extractor behind nano_rest_post_extract */
+
+#ifndef __NANO_REST_JSON_H__
+#define __NANO_REST_JSON_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nano_rest.h"
+
+#define JSON_MAX_FIELDS 32
+// Paths can address this many levels; deeper values are parsed but skipped
+#define JSON_MAX_DEPTH 8
+// Longer member names never match
+#define JSON_KEY_MAX 72
+
+typedef struct json_parser_t {
+    nano_rest_json_field_t *fields;
+    uint8_t n_fields;
+    uint8_t state;
+    uint8_t depth; // containers open
+    uint8_t unicode_left; // hex digits of a \u escape still to come
+    bool in_key;
+    bool quoted; // the current scalar is a string
+    bool error; // malformed
+    bool full; // a value did not fit into its field
+    uint32_t arrays; // bit d set if the container at depth d + 1 is an array
+    // Fields whose path leads into the container at each depth
+    uint32_t mask[JSON_MAX_DEPTH + 1];
+    uint32_t next; // fields whose path leads into the value about to start
+    uint32_t term; // fields that take the value about to start
+    size_t key_len;
+    char key[JSON_KEY_MAX];
+    size_t value_len;
+    char scratch[24]; // start of the current scalar, for numbers and bools
+} json_parser_t;
+
+void json_begin(json_parser_t *p, nano_rest_json_field_t *fields,
+        size_t n_fields);
+void json_feed(json_parser_t *p, const char *data, size_t len);
+/* Returns 0 if a complete document has been fed and every value found
+ * fitted into its field, -1 otherwise */
+int json_end(json_parser_t *p);
+
+/* Finds member name of the object at obj, a NUL-terminated document.
+ * Returns the start of its value and sets *end past it, or returns NULL if
+ * absent or malformed. */
+const char *json_find_member(const char *obj, const char *name,
+        const char **end);
+
+#endif
@@ -0,0 +1,228 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Coalesces per-account queries into the plural Nano RPCs. The first query
+ * of a kind opens a group and waits CONFIG_NANO_REST_COALESCE_WINDOW ms for
+ * others to join; it then sends one RPC for the whole group and hands each
+ * member its own part of the reply. */
+
+#include "sdkconfig.h"
+#define LOG_LOCAL_LEVEL CONFIG_NANO_REST_LOG_LEVEL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "nano_rest.h"
+#include "nano_rest_json.h"
+
+static const char *TAG = "network_rest";
+
+// Nano accounts are 64-65 characters, block hashes 64
+#define QUERY_KEY_MAX_LEN 70
+// Room for each member's key and punctuation in the plural reply
+#define QUERY_REPLY_OVERHEAD (QUERY_KEY_MAX_LEN + 16)
+#define QUERY_PENDING_COUNT "16"
+
+typedef struct query_kind_t {
+    const char *action;
+    const char *list; // request member listing the keys
+    const char *reply; // reply member holding an object keyed by them
+    const char *params; // extra request members
+} query_kind_t;
+
+static const query_kind_t query_kinds[] = {
+    [NANO_REST_QUERY_BALANCE] = {
+        "accounts_balances", "accounts", "balances", "" },
+    [NANO_REST_QUERY_FRONTIER] = {
+        "accounts_frontiers", "accounts", "frontiers", "" },
+    [NANO_REST_QUERY_PENDING] = {
+        "accounts_pending", "accounts", "blocks",
+        ",\"count\":\"" QUERY_PENDING_COUNT "\"" },
+    [NANO_REST_QUERY_BLOCK_INFO] = {
+        "blocks_info", "hashes", "blocks", "" },
+};
+
+#define QUERY_KIND_COUNT (sizeof(query_kinds) / sizeof(query_kinds[0]))
+
+/* A caller waiting for its part of a plural reply. Lives on the caller's
+ * stack; the group leader fills in the result and gives done. A group is
+ * a list headed by its leader. */
+typedef struct query_waiter_t {
+    const char *key;
+    char *result_data_buf;
+    size_t result_data_buf_len;
+    int status;
+    SemaphoreHandle_t done;
+    size_t n; // group size, leader only
+    struct query_waiter_t *next;
+} query_waiter_t;
+
+static portMUX_TYPE query_mux = portMUX_INITIALIZER_UNLOCKED;
+static query_waiter_t *query_open[QUERY_KIND_COUNT]; // leaders accepting members
+
+/* Sends the plural RPC for a closed group and completes every member but
+ * the leader, whose result is left in its waiter. */
+static void query_group_run(const query_kind_t *kind, query_waiter_t *waiters) {
+    size_t rpc_len = strlen(kind->action) + strlen(kind->list) +
+            strlen(kind->params) + 32;
+    size_t reply_len = 32;
+    for( query_waiter_t *w = waiters; NULL != w; w = w->next ) {
+        rpc_len += strlen(w->key) + 3;
+        reply_len += w->result_data_buf_len + QUERY_REPLY_OVERHEAD;
+    }
+    if( reply_len > CONFIG_NANO_REST_RECEIVE_MAX_SIZE ) {
+        reply_len = CONFIG_NANO_REST_RECEIVE_MAX_SIZE;
+    }
+    char *rpc = malloc(rpc_len);
+    char *reply = malloc(reply_len);
+    if( NULL == rpc || NULL == reply ) {
+        ESP_LOGE(TAG, "Unable to allocate coalesced query");
+        goto exit;
+    }
+
+    size_t len = snprintf(rpc, rpc_len, "{\"action\":\"%s\",\"%s\":[",
+            kind->action, kind->list);
+    for( query_waiter_t *w = waiters; NULL != w; w = w->next ) {
+        bool dup = false;
+        for( query_waiter_t *v = waiters; v != w; v = v->next ) {
+            if( 0 == strcmp(v->key, w->key) ) {
+                dup = true;
+                break;
+            }
+        }
+        if( !dup ) {
+            len += snprintf(&rpc[len], rpc_len - len, "%s\"%s\"",
+                    ('[' == rpc[len - 1]) ? "" : ",", w->key);
+        }
+    }
+    snprintf(&rpc[len], rpc_len - len, "]%s}", kind->params);
+#if CONFIG_NANO_REST_LOG_PAYLOADS
+    ESP_LOGI(TAG, "Coalesced query: %s", rpc);
+#endif
+
+    if( 0 != network_get_data(rpc, reply, reply_len) ) {
+        goto exit;
+    }
+    const char *members_end;
+    const char *members = json_find_member(reply, kind->reply, &members_end);
+    if( NULL == members ) {
+        ESP_LOGE(TAG, "No \"%s\" in reply to %s", kind->reply, kind->action);
+        goto exit;
+    }
+    for( query_waiter_t *w = waiters; NULL != w; w = w->next ) {
+        const char *end;
+        const char *value = json_find_member(members, w->key, &end);
+        if( NULL == value || end > members_end ) {
+            continue;
+        }
+        size_t value_len = end - value;
+        if( value_len >= w->result_data_buf_len ) {
+            ESP_LOGE(TAG, "Insufficient result buffer.");
+            continue;
+        }
+        memcpy(w->result_data_buf, value, value_len);
+        w->result_data_buf[value_len] = '\0';
+        w->status = 0;
+    }
+
+exit:
+    if( rpc ) {
+        free(rpc);
+    }
+    if( reply ) {
+        free(reply);
+    }
+    for( query_waiter_t *w = waiters, *next; NULL != w; w = next ) {
+        next = w->next; // w may be gone once done is given
+        if( w != waiters ) {
+            xSemaphoreGive(w->done);
+        }
+    }
+}
+
+int nano_rest_query(nano_rest_query_t kind, const char *key,
+        char *result_data_buf, size_t result_data_buf_len) {
+    if( (size_t)kind >= QUERY_KIND_COUNT || NULL == key ||
+            strlen(key) > QUERY_KEY_MAX_LEN || 0 == result_data_buf_len ) {
+        return -1;
+    }
+    result_data_buf[0] = '\0';
+    // Keys are pasted into the RPC as is
+    for( const char *c = key; '\0' != *c; c++ ) {
+        if( !isalnum((unsigned char)*c) && '_' != *c ) {
+            ESP_LOGE(TAG, "Invalid query key %s", key);
+            return -1;
+        }
+    }
+
+    query_waiter_t self = {
+        .key = key,
+        .result_data_buf = result_data_buf,
+        .result_data_buf_len = result_data_buf_len,
+        .status = -1,
+    };
+    self.done = xSemaphoreCreateBinary();
+    if( NULL == self.done ) {
+        ESP_LOGE(TAG, "Unable to allocate query");
+        return -1;
+    }
+
+    query_waiter_t *leader;
+    bool wake = false;
+    portENTER_CRITICAL(&query_mux);
+    leader = query_open[kind];
+    if( NULL == leader ) {
+        query_open[kind] = &self;
+        self.n = 1;
+    }
+    else {
+        self.next = leader->next;
+        leader->next = &self;
+        if( ++leader->n >= CONFIG_NANO_REST_COALESCE_MAX ) {
+            // Full; close it and let the leader go early
+            query_open[kind] = NULL;
+            wake = true;
+        }
+    }
+    portEXIT_CRITICAL(&query_mux);
+
+    if( NULL != leader ) {
+        if( wake ) {
+            xSemaphoreGive(leader->done);
+        }
+        xSemaphoreTake(self.done, portMAX_DELAY);
+        vSemaphoreDelete(self.done);
+        return self.status;
+    }
+
+    bool woken = false;
+    if( CONFIG_NANO_REST_COALESCE_MAX > 1 ) {
+        woken = pdTRUE == xSemaphoreTake(self.done,
+                pdMS_TO_TICKS(CONFIG_NANO_REST_COALESCE_WINDOW));
+    }
+    portENTER_CRITICAL(&query_mux);
+    bool filled = query_open[kind] != &self;
+    if( !filled ) {
+        query_open[kind] = NULL;
+    }
+    portEXIT_CRITICAL(&query_mux);
+    if( filled && !woken ) {
+        // The member that filled the group has yet to give done, which
+        // must not be deleted before it has
+        xSemaphoreTake(self.done, portMAX_DELAY);
+    }
+
+    ESP_LOGD(TAG, "%s for %d key(s)", query_kinds[kind].action, (int)self.n);
+    query_group_run(&query_kinds[kind], &self);
+    vSemaphoreDelete(self.done);
+    return self.status;
+}
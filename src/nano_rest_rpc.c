@@ -0,0 +1,201 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Typed RPCs. Each action is described at compile time by the literal
+ * pieces of its JSON and the kind of each argument, so the length of a
+ * request is known before it is written and the body is written once,
+ * straight into the buffer it is sent from. */
+
+#include "sdkconfig.h"
+#define LOG_LOCAL_LEVEL CONFIG_NANO_REST_LOG_LEVEL
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "nano_rest.h"
+#include "nano_rest_rpc.h"
+
+static const char *TAG = "network_rest";
+
+typedef struct rpc_literal_t {
+    const char *str;
+    uint8_t len;
+} rpc_literal_t;
+
+typedef struct rpc_arg_t {
+    rpc_literal_t name; // ,"name": and the opening quote of a string
+    bool raw; // JSON pasted as is, otherwise a string
+} rpc_arg_t;
+
+typedef struct rpc_spec_t {
+    rpc_literal_t action;
+    rpc_literal_t head; // {"action":"..."
+    uint8_t n_args;
+    rpc_arg_t args[RPC_MAX_ARGS];
+    rpc_literal_t tail; // fixed parameters and the closing brace
+} rpc_spec_t;
+
+#define RPC_LITERAL(s) { s, sizeof(s) - 1 }
+#define RPC_ACTION(name) \
+        .action = RPC_LITERAL(name), \
+        .head = RPC_LITERAL("{\"action\":\"" name "\"")
+#define RPC_STRING(name) { RPC_LITERAL(",\"" name "\":\""), false }
+#define RPC_JSON(name) { RPC_LITERAL(",\"" name "\":"), true }
+#define RPC_TAIL(params) .tail = RPC_LITERAL(params "}")
+
+static const rpc_spec_t rpc_specs[] = {
+    [RPC_ACCOUNT_BALANCE] = {
+        RPC_ACTION("account_balance"), 1, { RPC_STRING("account") },
+        RPC_TAIL("") },
+    [RPC_ACCOUNT_INFO] = {
+        RPC_ACTION("account_info"), 1, { RPC_STRING("account") },
+        RPC_TAIL(",\"representative\":\"true\",\"pending\":\"true\"") },
+    [RPC_ACCOUNT_REPRESENTATIVE] = {
+        RPC_ACTION("account_representative"), 1, { RPC_STRING("account") },
+        RPC_TAIL("") },
+    [RPC_ACTIVE_DIFFICULTY] = {
+        RPC_ACTION("active_difficulty"), RPC_TAIL("") },
+    [RPC_BLOCK_COUNT] = {
+        RPC_ACTION("block_count"), RPC_TAIL("") },
+    [RPC_BLOCK_INFO] = {
+        RPC_ACTION("block_info"), 1, { RPC_STRING("hash") },
+        RPC_TAIL(",\"json_block\":\"true\"") },
+    [RPC_PENDING] = {
+        RPC_ACTION("pending"), 2,
+        { RPC_STRING("account"), RPC_STRING("count") },
+        RPC_TAIL(",\"source\":\"true\"") },
+    [RPC_PROCESS] = {
+        RPC_ACTION("process"), 1, { RPC_JSON("block") },
+        RPC_TAIL(",\"json_block\":\"true\"") },
+    [RPC_WORK_GENERATE] = {
+        RPC_ACTION("work_generate"), 1, { RPC_STRING("hash") },
+        RPC_TAIL("") },
+};
+
+_Static_assert(sizeof(rpc_specs) / sizeof(rpc_specs[0]) == RPC_COUNT,
+        "rpc_specs does not cover every rpc_id_t");
+
+/* Length of a string argument, or 0 if it is not valid. String arguments
+ * are accounts, hashes and numbers, pasted in without escaping. */
+static size_t rpc_string_length(const char *arg) {
+    const char *p;
+    for( p = arg; '\0' != *p; p++ ) {
+        if( !isalnum((unsigned char)*p) && '_' != *p ) {
+            return 0;
+        }
+    }
+    return p - arg;
+}
+
+size_t rpc_length(rpc_id_t rpc, const char *const *args, size_t *arg_lens) {
+    const rpc_spec_t *spec = &rpc_specs[rpc];
+    size_t len = spec->head.len + spec->tail.len;
+    for( unsigned i = 0; i < spec->n_args; i++ ) {
+        const rpc_arg_t *arg = &spec->args[i];
+        arg_lens[i] = 0;
+        if( NULL != args[i] ) {
+            arg_lens[i] = arg->raw ? strlen(args[i]) :
+                    rpc_string_length(args[i]);
+        }
+        if( 0 == arg_lens[i] ) {
+            ESP_LOGE(TAG, "Invalid %.*s argument", spec->action.len,
+                    spec->action.str);
+            return 0;
+        }
+        len += arg->name.len + arg_lens[i] + (arg->raw ? 0 : 1);
+    }
+    return len;
+}
+
+static char *rpc_put(char *dst, const char *src, size_t len) {
+    memcpy(dst, src, len);
+    return dst + len;
+}
+
+void rpc_write(rpc_id_t rpc, const char *const *args,
+        const size_t *arg_lens, char *dst) {
+    const rpc_spec_t *spec = &rpc_specs[rpc];
+    dst = rpc_put(dst, spec->head.str, spec->head.len);
+    for( unsigned i = 0; i < spec->n_args; i++ ) {
+        const rpc_arg_t *arg = &spec->args[i];
+        dst = rpc_put(dst, arg->name.str, arg->name.len);
+        dst = rpc_put(dst, args[i], arg_lens[i]);
+        if( !arg->raw ) {
+            *dst++ = '"';
+        }
+    }
+    rpc_put(dst, spec->tail.str, spec->tail.len);
+}
+
+const char *rpc_action(rpc_id_t rpc, size_t *len) {
+    *len = rpc_specs[rpc].action.len;
+    return rpc_specs[rpc].action.str;
+}
+
+int nano_rest_account_balance(const char *account,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { account };
+    return http_rpc(RPC_ACCOUNT_BALANCE, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_account_info(const char *account,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { account };
+    return http_rpc(RPC_ACCOUNT_INFO, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_account_representative(const char *account,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { account };
+    return http_rpc(RPC_ACCOUNT_REPRESENTATIVE, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_active_difficulty(char *result_data_buf,
+        size_t result_data_buf_len) {
+    return http_rpc(RPC_ACTIVE_DIFFICULTY, NULL,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_block_count(char *result_data_buf, size_t result_data_buf_len) {
+    return http_rpc(RPC_BLOCK_COUNT, NULL,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_block_info(const char *hash,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { hash };
+    return http_rpc(RPC_BLOCK_INFO, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_pending(const char *account, uint32_t count,
+        char *result_data_buf, size_t result_data_buf_len) {
+    char count_str[11];
+    snprintf(count_str, sizeof(count_str), "%u", (unsigned)count);
+    const char *args[] = { account, count_str };
+    return http_rpc(RPC_PENDING, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_process(const char *block_json,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { block_json };
+    return http_rpc(RPC_PROCESS, args,
+            result_data_buf, result_data_buf_len);
+}
+
+int nano_rest_work_generate(const char *hash,
+        char *result_data_buf, size_t result_data_buf_len) {
+    const char *args[] = { hash };
+    return http_rpc(RPC_WORK_GENERATE, args,
+            result_data_buf, result_data_buf_len);
+}
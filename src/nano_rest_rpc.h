@@ -0,0 +1,43 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Serialization of the typed RPCs, see nano_rest_rpc.c */
+
+#ifndef __NANO_REST_RPC_H__
+#define __NANO_REST_RPC_H__
+
+#include <stddef.h>
+
+#define RPC_MAX_ARGS 2
+
+typedef enum rpc_id_t {
+    RPC_ACCOUNT_BALANCE = 0,
+    RPC_ACCOUNT_INFO,
+    RPC_ACCOUNT_REPRESENTATIVE,
+    RPC_ACTIVE_DIFFICULTY,
+    RPC_BLOCK_COUNT,
+    RPC_BLOCK_INFO,
+    RPC_PENDING,
+    RPC_PROCESS,
+    RPC_WORK_GENERATE,
+    RPC_COUNT
+} rpc_id_t;
+
+/* Length of the request body for rpc with args, or 0 if an argument is
+ * invalid. Stores the length of each argument in arg_lens, which holds
+ * RPC_MAX_ARGS entries. */
+size_t rpc_length(rpc_id_t rpc, const char *const *args, size_t *arg_lens);
+/* Writes the rpc_length() bytes of the request body to dst */
+void rpc_write(rpc_id_t rpc, const char *const *args,
+        const size_t *arg_lens, char *dst);
+/* Name of the action rpc sends, *len characters long */
+const char *rpc_action(rpc_id_t rpc, size_t *len);
+
+/* Sends rpc and waits for the response, like network_get_data. Provided by
+ * nano_rest.c. */
+int http_rpc(rpc_id_t rpc, const char *const *args,
+        char *result_data_buf, size_t result_data_buf_len);
+
+#endif
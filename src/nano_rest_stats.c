@@ -0,0 +1,207 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Event counters, and rolling latency histograms per request phase.
+ * Latency samples go into the log-linear buckets (four per power of two,
+ * up to ~16 s) of the current window; a window is retired after
+ * CONFIG_NANO_REST_STATS_WINDOW seconds and reports cover the current and
+ * the previous one. */
+
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nano_rest.h"
+#include "nano_rest_stats.h"
+
+#if CONFIG_NANO_REST_TRACE
+nano_rest_trace_t stats_trace;
+#endif
+
+void nano_rest_get_trace(nano_rest_trace_t *trace) {
+#if CONFIG_NANO_REST_TRACE
+    *trace = stats_trace;
+#else
+    memset(trace, 0, sizeof(nano_rest_trace_t));
+#endif
+}
+
+#if CONFIG_NANO_REST_STATS
+
+#define STATS_SUB_BITS 2 // buckets per power of two, log2
+#define STATS_MIN_SHIFT 2 // resolution of the first buckets, log2 us
+#define STATS_MAX_SHIFT 24 // samples of 2^24 us and more share the last
+#define STATS_BUCKETS \
+        ((STATS_MAX_SHIFT - STATS_MIN_SHIFT - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+#define STATS_WINDOW_US ((int64_t)CONFIG_NANO_REST_STATS_WINDOW * 1000000)
+
+typedef struct stats_hist_t {
+    uint16_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint16_t bucket[STATS_BUCKETS];
+} stats_hist_t;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static stats_hist_t stats_hist[2][NANO_REST_PHASE_COUNT];
+static uint8_t stats_cur = 0;
+static int64_t stats_window_start = 0;
+
+static unsigned stats_bucket(uint32_t us) {
+    if( us < (1u << (STATS_MIN_SHIFT + STATS_SUB_BITS)) ) {
+        return us >> STATS_MIN_SHIFT;
+    }
+    unsigned msb = 31 - __builtin_clz(us);
+    unsigned i = ((msb - STATS_MIN_SHIFT - STATS_SUB_BITS + 1) << STATS_SUB_BITS) +
+            ((us >> (msb - STATS_SUB_BITS)) & ((1u << STATS_SUB_BITS) - 1));
+    return (i < STATS_BUCKETS) ? i : STATS_BUCKETS - 1;
+}
+
+/* Smallest sample that falls into bucket i */
+static uint32_t stats_bucket_floor(unsigned i) {
+    unsigned sub = i & ((1u << STATS_SUB_BITS) - 1);
+    unsigned octave = i >> STATS_SUB_BITS;
+    if( 0 == octave ) {
+        return sub << STATS_MIN_SHIFT;
+    }
+    unsigned msb = octave + STATS_MIN_SHIFT + STATS_SUB_BITS - 1;
+    return (1u << msb) + (sub << (msb - STATS_SUB_BITS));
+}
+
+static void stats_clear(stats_hist_t *h) {
+    memset(h, 0, sizeof(stats_hist_t) * NANO_REST_PHASE_COUNT);
+}
+
+/* Retires the current window if it has run its course. Called with
+ * stats_mux held. */
+static void stats_roll(int64_t now) {
+    int64_t age = now - stats_window_start;
+    if( age < STATS_WINDOW_US ) {
+        return;
+    }
+    stats_cur ^= 1;
+    stats_clear(stats_hist[stats_cur]);
+    if( age >= 2 * STATS_WINDOW_US ) {
+        stats_clear(stats_hist[stats_cur ^ 1]);
+    }
+    stats_window_start = now;
+}
+
+void stats_record_us(nano_rest_phase_t phase, uint32_t us) {
+    int64_t now = stats_now();
+    portENTER_CRITICAL(&stats_mux);
+    stats_roll(now);
+    stats_hist_t *h = &stats_hist[stats_cur][phase];
+    if( UINT16_MAX == h->count ) {
+        // Busy window; start the next one early rather than saturate
+        stats_window_start = now - STATS_WINDOW_US;
+        stats_roll(now);
+        h = &stats_hist[stats_cur][phase];
+    }
+    if( 0 == h->count || us < h->min_us ) {
+        h->min_us = us;
+    }
+    if( us > h->max_us ) {
+        h->max_us = us;
+    }
+    h->count++;
+    h->bucket[stats_bucket(us)]++;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+void stats_record(nano_rest_phase_t phase, int64_t start_us) {
+    int64_t us = stats_now() - start_us;
+    stats_record_us(phase, (us > 0) ? (us < UINT32_MAX ? us : UINT32_MAX) : 0);
+}
+
+/* Value below which pct percent of the samples lie, to bucket resolution */
+static uint32_t stats_percentile(const stats_hist_t *a, const stats_hist_t *b,
+        const nano_rest_latency_t *l, unsigned pct) {
+    uint32_t rank = (l->count * pct + 99) / 100;
+    uint32_t seen = 0;
+    unsigned i;
+    for( i = 0; i < STATS_BUCKETS - 1; i++ ) {
+        seen += a->bucket[i] + b->bucket[i];
+        if( seen >= rank ) {
+            break;
+        }
+    }
+    uint32_t us = (i < STATS_BUCKETS - 1) ? stats_bucket_floor(i + 1) - 1 : l->max_us;
+    if( us > l->max_us ) {
+        us = l->max_us;
+    }
+    if( us < l->min_us ) {
+        us = l->min_us;
+    }
+    return us;
+}
+
+/* Copies both windows of phase, so they can be summarized without
+ * holding stats_mux */
+static void stats_snapshot(int p, stats_hist_t *a, stats_hist_t *b) {
+    portENTER_CRITICAL(&stats_mux);
+    stats_roll(stats_now());
+    *a = stats_hist[0][p];
+    *b = stats_hist[1][p];
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/* Summarizes the two windows of a phase */
+static void stats_summarize(const stats_hist_t *a, const stats_hist_t *b,
+        nano_rest_latency_t *l) {
+    memset(l, 0, sizeof(nano_rest_latency_t));
+    l->count = a->count + b->count;
+    if( 0 == l->count ) {
+        return;
+    }
+    l->min_us = UINT32_MAX;
+    if( a->count ) {
+        l->min_us = a->min_us;
+        l->max_us = a->max_us;
+    }
+    if( b->count ) {
+        l->min_us = (b->min_us < l->min_us) ? b->min_us : l->min_us;
+        l->max_us = (b->max_us > l->max_us) ? b->max_us : l->max_us;
+    }
+    l->p50_us = stats_percentile(a, b, l, 50);
+    l->p95_us = stats_percentile(a, b, l, 95);
+    l->p99_us = stats_percentile(a, b, l, 99);
+}
+
+uint32_t stats_p95_us(nano_rest_phase_t phase) {
+    stats_hist_t a, b;
+    nano_rest_latency_t l;
+    stats_snapshot(phase, &a, &b);
+    stats_summarize(&a, &b, &l);
+    return l.p95_us;
+}
+
+void nano_rest_get_stats(nano_rest_stats_t *stats) {
+    stats_hist_t a, b;
+    for( int p = 0; p < NANO_REST_PHASE_COUNT; p++ ) {
+        stats_snapshot(p, &a, &b);
+        stats_summarize(&a, &b, &stats->phase[p]);
+    }
+}
+
+void nano_rest_reset_stats(void) {
+    portENTER_CRITICAL(&stats_mux);
+    stats_clear(stats_hist[0]);
+    stats_clear(stats_hist[1]);
+    stats_window_start = stats_now();
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+#else
+
+void nano_rest_get_stats(nano_rest_stats_t *stats) {
+    memset(stats, 0, sizeof(nano_rest_stats_t));
+}
+
+void nano_rest_reset_stats(void) {
+}
+
+#endif
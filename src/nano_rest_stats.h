@@ -0,0 +1,58 @@
+/* nano_rest - restful wrapper
+ Copyright (C) 2018  Brian Pugh, James Coxon, Michael Smaili
+ https://www.joltwallet.com/
+ */
+
+/* Per-phase latency recording and event counters, used by the http_rest
+ * task */
+
+#ifndef __NANO_REST_STATS_H__
+#define __NANO_REST_STATS_H__
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "nano_rest.h"
+
+#if CONFIG_NANO_REST_TRACE
+/* Only written by the http_rest task, so plain increments suffice */
+extern nano_rest_trace_t stats_trace;
+#define TRACE_ADD(counter, n) (stats_trace.counter += (n))
+#else
+#define TRACE_ADD(counter, n) do { } while(0)
+#endif
+#define TRACE_COUNT(counter) TRACE_ADD(counter, 1)
+
+#if CONFIG_NANO_REST_STATS
+
+#include "esp_timer.h"
+
+static inline int64_t stats_now(void) {
+    return esp_timer_get_time();
+}
+
+/* Adds a sample of now - start_us microseconds to phase */
+void stats_record(nano_rest_phase_t phase, int64_t start_us);
+/* Adds an already measured duration to phase */
+void stats_record_us(nano_rest_phase_t phase, uint32_t us);
+/* 95th percentile of the recent samples of phase, 0 if there are none */
+uint32_t stats_p95_us(nano_rest_phase_t phase);
+
+#else
+
+static inline int64_t stats_now(void) {
+    return 0;
+}
+
+static inline void stats_record(nano_rest_phase_t phase, int64_t start_us) {
+}
+
+static inline void stats_record_us(nano_rest_phase_t phase, uint32_t us) {
+}
+
+static inline uint32_t stats_p95_us(nano_rest_phase_t phase) {
+    return 0;
+}
+
+#endif
+
+#endif